@@ -54,6 +54,7 @@ _create_data(E_Config_Dialog *cfd)
 
     /* Handle things which can't be easily memcpy'd */
     cfdata->config.vdesks = NULL;
+    cfdata->config.rules = NULL; /* not edited here */
 
     for (Eina_List *l = tiling_g.config->vdesks; l; l = l->next) {
         struct _Config_vdesk *vd = l->data,
@@ -163,6 +164,7 @@ _basic_create_widgets(E_Config_Dialog      *cfd,
                       E_Config_Dialog_Data *cfdata)
 {
     Evas_Object *o, *oc, *of;
+    E_Radio_Group *rg;
     E_Container *con = e_container_current_get(e_manager_current_get());
     E_Zone *zone;
 
@@ -183,6 +185,26 @@ _basic_create_widgets(E_Config_Dialog      *cfd,
       e_widget_entry_add(evas, &cfdata->config.keyhints, NULL, NULL, NULL),
       1, 1, 0.5);
     e_widget_framelist_object_append(of, oc);
+    oc = e_widget_list_add(evas, false, true);
+    e_widget_list_object_append(oc,
+      e_widget_label_add(evas, D_("Delay before tiling new windows")),
+      1, 0, 0.5);
+    e_widget_list_object_append(oc,
+      e_widget_slider_add(evas, 1, 0, D_("%1.0f ms"), 0.0, 500.0, 10.0, 0,
+                          NULL, &cfdata->config.add_delay, 150),
+      1, 1, 0.5);
+    e_widget_framelist_object_append(of, oc);
+    oc = e_widget_list_add(evas, false, true);
+    e_widget_list_object_append(oc,
+      e_widget_label_add(evas, D_("Animated arrows")), 1, 0, 0.5);
+    rg = e_widget_radio_group_new(&cfdata->config.animations);
+    e_widget_list_object_append(oc,
+      RADIO("Auto", TILING_ANIMATIONS_AUTO, rg), 1, 0, 0.5);
+    e_widget_list_object_append(oc,
+      RADIO("Yes", TILING_ANIMATIONS_ON, rg), 1, 0, 0.5);
+    e_widget_list_object_append(oc,
+      RADIO("No", TILING_ANIMATIONS_OFF, rg), 1, 0, 0.5);
+    e_widget_framelist_object_append(of, oc);
 
     LIST_ADD(o, of);
 
@@ -230,6 +252,8 @@ _basic_apply_data(E_Config_Dialog      *cfd,
 
     tiling_g.config->tile_dialogs = cfdata->config.tile_dialogs;
     tiling_g.config->show_titles = cfdata->config.show_titles;
+    tiling_g.config->add_delay = cfdata->config.add_delay;
+    tiling_g.config->animations = cfdata->config.animations;
     if (strcmp(tiling_g.config->keyhints, cfdata->config.keyhints)) {
         free(tiling_g.config->keyhints);
         if (!cfdata->config.keyhints || !*cfdata->config.keyhints) {
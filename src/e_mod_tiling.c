@@ -4,14 +4,52 @@
 
 #define TILING_OVERLAY_TIMEOUT 5.0
 #define TILING_RESIZE_STEP 5
+/* Key presses in a same direction less than TILING_KEY_REPEAT_DELAY ms
+ * apart are repeats. The step of transitions doubles every
+ * TILING_KEY_ACCEL_REPEATS repeats, at most TILING_KEY_ACCEL_MAX times */
+#define TILING_KEY_REPEAT_DELAY 150
+#define TILING_KEY_ACCEL_REPEATS 4
+#define TILING_KEY_ACCEL_MAX 4
+/* Thickness of the input windows over the boundaries between windows */
+#define TILING_HANDLE_SIZE 6
 #define TILING_POPUP_LAYER 101
+/* Layer of tiled windows, below the normal one */
+#define TILING_BORDER_LAYER 75
+/* Layer of the overlays drawn by the compositor, above every window */
+#define TILING_COMP_LAYER 32000
+/* Seconds for the usage of a window to count half as much in the
+ * choice of its hint */
+#define TILING_USAGE_HALFLIFE 14400.0
+/* Longest key hint, nul included */
+#define TILING_HINT_LEN 16
+/* Hidden popups kept ready per zone for the overlays */
+#define TILING_OVERLAY_POOL 16
 #define TILING_WRAP_SPEED 0.1
+/* A border corrected more than TILING_WATCHDOG_COUNT times within
+ * TILING_WATCHDOG_DELAY seconds is fighting the layout */
+#define TILING_WATCHDOG_COUNT 16
+#define TILING_WATCHDOG_DELAY 1.0
+/* Seconds of relayout jobs run per main loop iteration */
+#define TILING_JOBS_BUDGET 0.004
+/* Seconds to wait for the worker threads on shutdown */
+#define TILING_THREADS_TIMEOUT 1.0
+/* Number of windows whose placement is remembered */
+#define TILING_PLACEMENT_MAX 128
+/* Seconds before changed placements are saved */
+#define TILING_PLACEMENT_SAVE_DELAY 30.0
 
 typedef enum {
     TILING_RESIZE,
     TILING_MOVE,
 } tiling_change_t;
 
+/* Values of _G.tilable, which can not hold NULL */
+typedef enum {
+    TILABLE_UNKNOWN,
+    TILABLE_NO,
+    TILABLE_YES,
+} tilable_t;
+
 typedef enum {
     INPUT_MODE_NONE,
     INPUT_MODE_SWAPPING,
@@ -29,25 +67,145 @@ typedef enum {
     MOVE_COUNT
 } tiling_move_t;
 
+/* Kinds of overlays, whose theme is resolved once, see
+ * _overlay_themes_load(). Move arrows are in the order of tiling_move_t */
+typedef enum {
+    OVERLAY_HINT,
+    OVERLAY_MOVE_UP,
+    OVERLAY_MOVE_DOWN,
+    OVERLAY_MOVE_LEFT,
+    OVERLAY_MOVE_RIGHT,
+    OVERLAY_TRANSITION_HORIZONTAL,
+    OVERLAY_TRANSITION_VERTICAL,
+
+    OVERLAY_COUNT
+} overlay_type_t;
+
 typedef struct geom_t {
     int x, y, w, h;
 } geom_t;
 
+/* Resolved theme of an overlay kind, and its minimum size once known */
+typedef struct overlay_theme_t {
+    const char *file;
+    const char *group;
+    Evas_Coord w, h;
+} overlay_theme_t;
+
+/* One window of a stack, as seen by the layout solver. @max is 0 when
+ * the span can grow without bound, @step is 0 when it can take any size
+ * and its sizes are @base plus a multiple of @step otherwise */
+typedef struct span_t {
+    double weight;
+    int min, max;
+    int base, step;
+} span_t;
+
+/* A rule of the configuration and its rank in it */
+typedef struct rule_t {
+    const struct _Config_rule *conf;
+    unsigned int order;
+} rule_t;
+
+typedef struct layout_cost_t {
+    int resized;
+    long long area;
+} layout_cost_t;
+
+/* What laying a hidden desk out on a worker thread needs, copied from
+ * its Tiling_Info and Border_Extras when queued, see
+ * _relayout_desk_async() */
+typedef struct snapshot_t {
+    const E_Desk *desk;
+    geom_t zone;
+    bool use_rows;
+    int nb_stacks;
+    int counts[TILING_MAX_STACKS];
+    span_t stacks[TILING_MAX_STACKS];
+    int count;
+    span_t *spans;
+    Ecore_Thread *thread;
+    /* Under _G.snapshots_lock: once finished, @thread is gone */
+    bool cancelled;
+    bool finished;
+    /* Never dereferenced by the worker, only compared once back */
+    E_Border **borders;
+
+    /* Results */
+    int pos[TILING_MAX_STACKS];
+    int size[TILING_MAX_STACKS];
+    geom_t *geoms;
+} snapshot_t;
+
+/* An overlay is drawn on a popup of its own, on the key hint canvas of
+ * its zone, or straight on the canvas of the compositor, where @popup is
+ * NULL. See _overlay_acquire() */
 typedef struct overlay_t {
     E_Popup *popup;
     Evas_Object *obj;
+    E_Zone *zone;
+    /* Whether @popup is shared and @obj is moved within it */
+    bool shared;
 } overlay_t;
 
+/* A transparent popup covering a zone, on which every key hint of the
+ * zone is drawn, see _hint_acquire() */
+typedef struct hint_canvas_t {
+    E_Popup *popup;
+    /* Hidden hint objects, ready to be used again */
+    Eina_List *spares;
+    int used;
+} hint_canvas_t;
+
+/* A node of the trie of key hints. Children are contiguous and the
+ * leaves below a node are a range of the leaves in depth-first order */
+typedef struct hint_node_t {
+    int parent;
+    /* First child, -1 for a leaf */
+    int child;
+    int nb_children;
+    int first, count;
+} hint_node_t;
+
+/* An input window over the boundary between @bd and the next window of
+ * @stack, or between @stack and the next one when @bd is NULL, to drag
+ * it with the mouse. See _handles_update_job() */
+typedef struct handle_t {
+    Ecore_X_Window win;
+    Ecore_X_Window parent;
+    /* NULL when the handle is not in use */
+    const E_Desk *desk;
+    int stack;
+    E_Border *bd;
+    /* Whether the boundary moves along the y axis */
+    bool vertical;
+    geom_t geom;
+} handle_t;
+
 typedef struct transition_overlay_t {
     overlay_t overlay;
     int stack;
-    char key[4];
+    char key[TILING_HINT_LEN];
     E_Border *bd;
 } transition_overlay_t;
 
 typedef struct Border_Extra {
     E_Border *border;
     geom_t expected;
+    /* Share of its stack, in pixels along the stack. 0 until the border
+     * has been laid out once */
+    int weight;
+    /* Maximize directions wanted by the layout, applied by
+     * _commit_border() */
+    E_Maximize maximize;
+    /* Ring of the times the border was last corrected, see
+     * _watchdog_tripped() */
+    double corrections[TILING_WATCHDOG_COUNT];
+    int correction;
+    /* How often the window is focused or picked by its hint, halved
+     * every TILING_USAGE_HALFLIFE seconds, see _usage_bump() */
+    double usage;
+    double usage_time;
     struct {
          geom_t geom;
          unsigned int layer;
@@ -56,7 +214,7 @@ typedef struct Border_Extra {
          const char *bordername;
     } orig;
     overlay_t overlay;
-    char key[4];
+    char key[TILING_HINT_LEN];
 } Border_Extra;
 
 struct tiling_g tiling_g = {
@@ -68,6 +226,16 @@ struct tiling_g tiling_g = {
 
 static void
 _add_border(E_Border *bd);
+static void
+_queue_relayout(const E_Desk *desk);
+static void
+_add_borders(Eina_List *borders, bool apply_rules);
+static bool
+_watchdog_check(E_Border *bd, Border_Extra *extra);
+static void
+_transition_adjust_flush(void);
+static void
+end_special_input(void);
 
 /* }}} */
 /* Globals {{{ */
@@ -76,7 +244,12 @@ static struct tiling_mod_main_g
 {
     char                  edj_path[PATH_MAX];
     E_Config_DD          *config_edd,
-                         *vdesk_edd;
+                         *vdesk_edd,
+                         *rule_edd,
+                         *placements_edd,
+                         *placement_edd,
+                         *layout_edd,
+                         *layout_window_edd;
     int                   currently_switching_desktop;
     Ecore_X_Window        action_input_win;
     Ecore_Event_Handler  *handler_key,
@@ -91,13 +264,79 @@ static struct tiling_mod_main_g
                          *handler_desk_show,
                          *handler_desk_before_show,
                          *handler_desk_set,
-                         *handler_container_resize;
-    E_Border_Hook        *pre_border_assign_hook;
+                         *handler_container_resize,
+                         *handler_zone_move_resize,
+                         *handler_zone_del,
+                         *handler_zone_desk_count_set,
+                         *handler_border_focus_in;
+    E_Border_Hook        *pre_border_assign_hook,
+                         *pre_fetch_hook;
 
     Tiling_Info          *tinfo;
     Eina_Hash            *info_hash;
     Eina_Hash            *border_extras;
     Eina_Hash            *overlays;
+    Eina_Hash            *tilable;
+
+    /* Hidden popups of each zone, see _overlay_acquire() */
+    Eina_Hash            *overlay_pool;
+    Ecore_Idler          *overlay_pool_idler;
+    /* Key hint canvas of each zone */
+    Eina_Hash            *hint_canvases;
+    /* Hidden overlay objects on each canvas of the compositor */
+    Eina_Hash            *comp_spares;
+    /* Ends the input mode once an overlay in use lost its canvas */
+    Ecore_Job            *comp_lost_job;
+
+    /* Desks waiting to be laid out again, see _queue_relayout() */
+    Eina_List            *relayout_desks;
+    Ecore_Idler          *relayout_idler;
+    /* Snapshots being solved by worker threads, which send them back
+     * through the pipe */
+    Eina_List            *snapshots;
+    Ecore_Pipe           *snapshots_pipe;
+    Eina_Lock             snapshots_lock;
+    Eina_Condition        snapshots_cond;
+    /* Workers inside _snapshot_solve(), under the lock */
+    int                   solving;
+
+    /* Handles over the boundaries of the visible desks, the ones in use
+     * first */
+    Eina_List            *handles;
+    Ecore_Job            *handles_job;
+    Ecore_Event_Handler  *handler_mouse_down,
+                         *handler_mouse_move,
+                         *handler_mouse_up;
+    /* Handle being dragged, and where its boundary and the pointer are
+     * along the axis it moves on, see _handle_drag_cb() */
+    struct {
+        handle_t         *handle;
+        Ecore_Animator   *animator;
+        int               pos,
+                          target;
+    } drag;
+
+    /* Rules indexed by the first field they match on, see
+     * _rules_compile() */
+    struct {
+        Eina_Hash        *by_class,
+                         *by_name,
+                         *by_role,
+                         *by_type;
+        rule_t           *all;
+        unsigned int      count;
+    } rules;
+
+    /* Last placement of closed windows, see _placement_remember() */
+    struct _Config_placements *placements;
+    Eina_Hash            *placement_hash;
+    bool                  placements_dirty;
+    Ecore_Timer          *placements_timer;
+
+    /* Saved layout of the windows not tiled again yet, by window id, see
+     * _layout_save() */
+    struct _Config_layout *layout;
+    Eina_Hash            *layout_hash;
 
     E_Action             *act_togglefloat,
                          *act_addstack,
@@ -117,15 +356,59 @@ static struct tiling_mod_main_g
     Ecore_Timer          *warp_timer;
 
     overlay_t             move_overlays[MOVE_COUNT];
+
+    /* Theme of each overlay kind, without and with compositing */
+    overlay_theme_t       themes[OVERLAY_COUNT][2];
+    /* Minimum size of hints, per number of characters */
+    /* Minimum size of each hint label, as two Evas_Coord */
+    Eina_Hash            *hint_sizes;
     transition_overlay_t *transition_overlay;
+    /* Moves of the transition overlay waiting for the next frame, and
+     * the last key press of the session, MOVE_COUNT if none, see
+     * _transition_move() */
+    struct {
+        int               delta;
+        Ecore_Animator   *animator;
+        tiling_move_t     direction;
+        unsigned int      timestamp;
+        int               repeats;
+    } adjust;
     Ecore_Timer          *action_timer;
     E_Border             *focused_bd;
     void (*action_cb)(E_Border *bd, Border_Extra *extra);
 
     tiling_input_mode_t   input_mode;
-    char                  keys[4];
+
+    /* Key hints being typed, see _hints_build() */
+    struct {
+        hint_node_t      *nodes;
+        int               nb_nodes;
+        int               current;
+        int               nb_leaves;
+        /* Node, data and overlay of each leaf, and leaf of each hint */
+        int              *leaves;
+        int              *item_leaf;
+        void            **data;
+        overlay_t       **overlays;
+        char              symbols[256];
+        int               nb_symbols;
+        /* Index in @symbols of each character, -1 if not a symbol */
+        short             index[256];
+    } hints;
+
+    /* Debug counters, see _rebalance_into() and _commit_border() */
+    struct {
+        unsigned int      rebalances;
+        unsigned int      resized;
+        unsigned int      cascade_resized;
+        long long         area;
+        long long         cascade_area;
+        unsigned int      commits;
+        unsigned int      maximize_changes;
+    } stats;
 } _G = {
     .input_mode = INPUT_MODE_NONE,
+    .adjust.direction = MOVE_COUNT,
 };
 
 /* }}} */
@@ -142,6 +425,62 @@ get_current_desk(void)
     return e_desk_current_get(z);
 }
 
+/* Whether @cb returns true for one of the zones of every container */
+static bool
+_zones_any(bool (*cb)(const E_Zone *zone, const void *data),
+           const void *data)
+{
+    Eina_List *l, *ll, *lll;
+    E_Manager *man;
+    E_Container *con;
+    E_Zone *zone;
+
+    EINA_LIST_FOREACH(e_manager_list(), l, man) {
+        EINA_LIST_FOREACH(man->containers, ll, con) {
+            EINA_LIST_FOREACH(con->zones, lll, zone) {
+                if (cb(zone, data))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool
+_zone_is(const E_Zone *zone, const void *data)
+{
+    return zone == data;
+}
+
+static bool
+_zone_has_desk(const E_Zone *zone, const void *data)
+{
+    int count = zone->desk_x_count * zone->desk_y_count;
+
+    for (int i = 0; i < count; i++) {
+        if (zone->desks[i] == data)
+            return true;
+    }
+
+    return false;
+}
+
+/* Whether @zone, which may be gone, is still a zone of a container */
+static bool
+_zone_exists(const E_Zone *zone)
+{
+    return _zones_any(_zone_is, zone);
+}
+
+/* Whether @desk, which may be gone, is still one of the desks of a
+ * zone */
+static bool
+_desk_exists(const E_Desk *desk)
+{
+    return _zones_any(_zone_has_desk, desk);
+}
+
 static Tiling_Info *
 _initialize_tinfo(const E_Desk *desk)
 {
@@ -157,6 +496,55 @@ _initialize_tinfo(const E_Desk *desk)
     return tinfo;
 }
 
+/* Membership index {{{ */
+
+static void
+_index_set_iconic(const E_Border *bd, bool iconic)
+{
+    Tiling_Info *tinfo = eina_hash_find(_G.info_hash, &bd->desk);
+
+    if (!tinfo)
+        return;
+
+    if (iconic) {
+        if (!EINA_LIST_IS_IN(tinfo->iconified_windows, bd))
+            EINA_LIST_APPEND(tinfo->iconified_windows, bd);
+    } else {
+        EINA_LIST_REMOVE(tinfo->iconified_windows, bd);
+    }
+}
+
+static void
+_index_add(E_Border *bd)
+{
+    Tiling_Info *tinfo;
+
+    if (!bd->desk)
+        return;
+
+    tinfo = eina_hash_find(_G.info_hash, &bd->desk);
+    if (!tinfo)
+        tinfo = _initialize_tinfo(bd->desk);
+
+    if (!EINA_LIST_IS_IN(tinfo->windows, bd))
+        EINA_LIST_APPEND(tinfo->windows, bd);
+    _index_set_iconic(bd, bd->iconic);
+}
+
+static void
+_index_remove(const E_Desk *desk, const E_Border *bd)
+{
+    Tiling_Info *tinfo = eina_hash_find(_G.info_hash, &desk);
+
+    if (!tinfo)
+        return;
+
+    EINA_LIST_REMOVE(tinfo->windows, bd);
+    EINA_LIST_REMOVE(tinfo->iconified_windows, bd);
+}
+
+/* }}} */
+
 static void
 check_tinfo(const E_Desk *desk)
 {
@@ -181,7 +569,7 @@ is_floating_window(const E_Border *bd)
 }
 
 static int
-is_tilable(const E_Border *bd)
+_compute_tilable(const E_Border *bd)
 {
     if (bd->client.icccm.min_h == bd->client.icccm.max_h
     &&  bd->client.icccm.max_h > 0)
@@ -198,6 +586,22 @@ is_tilable(const E_Border *bd)
     return true;
 }
 
+/* Cached in _G.tilable until the properties it depends on are fetched
+ * again, see _pre_fetch_hook() */
+static int
+is_tilable(const E_Border *bd)
+{
+    tilable_t tilable;
+
+    tilable = (intptr_t)eina_hash_find(_G.tilable, &bd);
+    if (tilable == TILABLE_UNKNOWN) {
+        tilable = _compute_tilable(bd) ? TILABLE_YES : TILABLE_NO;
+        eina_hash_add(_G.tilable, &bd, (void *)(intptr_t)tilable);
+    }
+
+    return tilable == TILABLE_YES;
+}
+
 static void
 change_window_border(E_Border   *bd,
                      const char *bordername)
@@ -256,19 +660,215 @@ get_transition_count(void)
     return res;
 }
 
+/* Returns the file of the current theme if it has @group, the module's
+ * theme if only it has it, NULL otherwise */
+static const char *
+_overlay_theme_find(const char *category, const char *group)
+{
+    const char *file = e_theme_edje_file_get(category, group);
+
+    if (file && file[0] && edje_file_group_exists(file, group))
+        return file;
+    if (edje_file_group_exists(_G.edj_path, group))
+        return _G.edj_path;
+    return NULL;
+}
+
+/* Whether the move and transition overlays loop their animations. By
+ * default they do not when the compositor draws in software, as every
+ * frame of an arrow then repaints the screen below it. */
+static bool
+_overlay_animated(void)
+{
+    E_Manager *man = e_manager_current_get();
+    Evas *evas;
+    const char *engine;
+
+    switch (tiling_g.config->animations) {
+      case TILING_ANIMATIONS_ON:
+        return true;
+      case TILING_ANIMATIONS_OFF:
+        return false;
+      default:
+        break;
+    }
+
+    if (!e_config->use_composite)
+        return true;
+
+    /* Overlays are drawn by the compositor when it has a canvas, see
+     * _overlay_comp_evas(), on alpha popups otherwise */
+    evas = man ? e_manager_comp_evas_get(man) : NULL;
+    if (!evas)
+        return e_canvas_engine_decide(e_config->evas_engine_popups)
+            == E_EVAS_ENGINE_GL_X11;
+
+    engine = ecore_evas_engine_name_get(ecore_evas_ecore_evas_get(evas));
+    return engine && strstr(engine, "gl");
+}
+
+/* Finds the file of the theme of every overlay kind, once for all:
+ * the current theme if it has the group, the module's theme otherwise.
+ * Looking the group up also loads the file in the cache of edje.
+ * Without animations, the "/static" variant of the group is preferred
+ * where a theme has one. */
+static void
+_overlay_themes_load(void)
+{
+    static const struct {
+        const char *category;
+        const char *group;
+        bool composite;
+    } kinds[OVERLAY_COUNT] = {
+        [OVERLAY_HINT] = {
+            "base/theme/borders", "e/widgets/border/default/resize", false,
+        },
+        [OVERLAY_MOVE_UP] = {
+            "base/theme/modules/e-tiling", "modules/e-tiling/move/up", true,
+        },
+        [OVERLAY_MOVE_DOWN] = {
+            "base/theme/modules/e-tiling", "modules/e-tiling/move/down", true,
+        },
+        [OVERLAY_MOVE_LEFT] = {
+            "base/theme/modules/e-tiling", "modules/e-tiling/move/left", true,
+        },
+        [OVERLAY_MOVE_RIGHT] = {
+            "base/theme/modules/e-tiling", "modules/e-tiling/move/right", true,
+        },
+        [OVERLAY_TRANSITION_HORIZONTAL] = {
+            "base/theme/modules/e-tiling",
+            "modules/e-tiling/transition/horizontal", true,
+        },
+        [OVERLAY_TRANSITION_VERTICAL] = {
+            "base/theme/modules/e-tiling",
+            "modules/e-tiling/transition/vertical", true,
+        },
+    };
+    bool animated = _overlay_animated();
+
+    for (int i = 0; i < OVERLAY_COUNT; i++) {
+        for (int composite = 0; composite < 2; composite++) {
+            overlay_theme_t *theme = &_G.themes[i][composite];
+            char group[PATH_MAX];
+            const char *file;
+
+            file = NULL;
+            if (!animated && i != OVERLAY_HINT) {
+                snprintf(group, sizeof(group), "%s%s/static", kinds[i].group,
+                         composite ? "/composite" : "");
+                file = _overlay_theme_find(kinds[i].category, group);
+            }
+            if (!file) {
+                snprintf(group, sizeof(group), "%s%s", kinds[i].group,
+                         composite && kinds[i].composite ? "/composite" : "");
+                file = _overlay_theme_find(kinds[i].category, group);
+            }
+
+            eina_stringshare_replace(&theme->file, file);
+            eina_stringshare_replace(&theme->group, group);
+            theme->w = theme->h = 0;
+        }
+    }
+    if (_G.hint_sizes)
+        eina_hash_free_buckets(_G.hint_sizes);
+    else
+        _G.hint_sizes = eina_hash_string_superfast_new(free);
+}
+
+static void
+_overlay_themes_free(void)
+{
+    for (int i = 0; i < OVERLAY_COUNT; i++) {
+        for (int composite = 0; composite < 2; composite++) {
+            eina_stringshare_replace(&_G.themes[i][composite].file, NULL);
+            eina_stringshare_replace(&_G.themes[i][composite].group, NULL);
+        }
+    }
+    if (_G.hint_sizes) {
+        eina_hash_free(_G.hint_sizes);
+        _G.hint_sizes = NULL;
+    }
+}
+
+static overlay_theme_t *
+_overlay_theme_get(overlay_type_t type)
+{
+    return &_G.themes[type][e_config->use_composite ? 1 : 0];
+}
+
 static void
-_theme_edje_object_set_aux(Evas_Object *obj, const char *group)
+_overlay_theme_set(Evas_Object *obj, overlay_type_t type)
 {
-    if (!e_theme_edje_object_set(obj, "base/theme/modules/e-tiling",
-                                 group)) {
-        edje_object_file_set(obj, _G.edj_path, group);
+    const overlay_theme_t *theme = _overlay_theme_get(type);
+
+    edje_object_file_set(obj, theme->file, theme->group);
+}
+
+/* Gives the minimum size of @obj, themed for @type, computing it only
+ * the first time for each kind, and for each @label for hints, as the
+ * font of hints is proportional. @label is set in @obj beforehand. */
+static void
+_overlay_size_get(Evas_Object *obj, overlay_type_t type, const char *label,
+                  Evas_Coord *w, Evas_Coord *h)
+{
+    Evas_Coord *size;
+
+    if (label) {
+        size = eina_hash_find(_G.hint_sizes, label);
+        if (!size) {
+            size = E_NEW(Evas_Coord, 2);
+            eina_hash_add(_G.hint_sizes, label, size);
+        }
+    } else {
+        overlay_theme_t *theme = _overlay_theme_get(type);
+
+        size = &theme->w;
+        if (!theme->w && !theme->h)
+            edje_object_size_min_calc(obj, &theme->w, &theme->h);
+    }
+    if (label && !size[0] && !size[1])
+        edje_object_size_min_calc(obj, &size[0], &size[1]);
+
+    *w = size[0];
+    *h = size[1];
+}
+
+/* Computes one of the sizes not known yet on @evas, the sizes of the
+ * hints of one character included. Returns false once they all are. */
+static bool
+_overlay_sizes_warm(Evas *evas)
+{
+    Evas_Object *obj;
+
+    for (int i = 0; i < OVERLAY_COUNT; i++) {
+        overlay_theme_t *theme = _overlay_theme_get(i);
+
+        if (theme->w || theme->h || i == OVERLAY_HINT)
+            continue;
+
+        obj = edje_object_add(evas);
+        _overlay_theme_set(obj, i);
+        edje_object_size_min_calc(obj, &theme->w, &theme->h);
+        evas_object_del(obj);
+        return true;
+    }
+    for (const char *c = tiling_g.config->keyhints; *c; c++) {
+        char label[2] = {*c, '\0'};
+        Evas_Coord w, h;
+
+        if (eina_hash_find(_G.hint_sizes, label))
+            continue;
+
+        obj = edje_object_add(evas);
+        _overlay_theme_set(obj, OVERLAY_HINT);
+        edje_object_part_text_set(obj, "e.text.label", label);
+        _overlay_size_get(obj, OVERLAY_HINT, label, &w, &h);
+        evas_object_del(obj);
+        return true;
     }
+
+    return false;
 }
-#define _theme_edje_object_set(_obj, _group)                                 \
-    if (e_config->use_composite)                                             \
-        _theme_edje_object_set_aux(_obj, _group"/composite");                \
-    else                                                                     \
-        _theme_edje_object_set_aux(_obj, _group);
 
 static Eina_Bool
 _info_hash_update(const Eina_Hash *hash, const void *key,
@@ -290,6 +890,11 @@ _info_hash_update(const Eina_Hash *hash, const void *key,
 void
 e_tiling_update_conf(void)
 {
+    /* animations may have changed */
+    _overlay_themes_load();
+
+    /* tile_dialogs may have changed */
+    eina_hash_free_buckets(_G.tilable);
     eina_hash_foreach(_G.info_hash, _info_hash_update, NULL);
 }
 
@@ -347,6 +952,71 @@ _e_border_unmaximize(E_Border *bd, E_Maximize max)
     e_border_unmaximize(bd, max);
 }
 
+/* Maximize directions a border should have once laid out in @stack
+ * holding @count borders */
+static E_Maximize
+_desired_maximize(int stack, int count)
+{
+    if (stack == 0 && count == 1 && !_G.tinfo->stacks[1])
+        return E_MAXIMIZE_BOTH;
+    if (count != 1)
+        return E_MAXIMIZE_NONE;
+    return _G.tinfo->conf->use_rows ? E_MAXIMIZE_HORIZONTAL
+                                    : E_MAXIMIZE_VERTICAL;
+}
+
+/* Applies the expected geometry of @bd and whatever differs between its
+ * maximize state and the wanted one, so that E is asked at most once per
+ * direction */
+static void
+_commit_border(E_Border *bd, Border_Extra *extra)
+{
+    E_Maximize want = extra->maximize & E_MAXIMIZE_DIRECTION;
+    E_Maximize have = bd->maximized & E_MAXIMIZE_DIRECTION;
+
+    _G.stats.commits++;
+
+    if (have & ~want) {
+        _e_border_unmaximize(bd, have & ~want);
+        _G.stats.maximize_changes++;
+    }
+    _e_border_move_resize(bd,
+                          extra->expected.x,
+                          extra->expected.y,
+                          extra->expected.w,
+                          extra->expected.h);
+    if (want & ~have) {
+        _e_border_maximize(bd, E_MAXIMIZE_EXPAND | (want & ~have));
+        _G.stats.maximize_changes++;
+    }
+
+    DBG("commits: %u, maximize changes: %u",
+        _G.stats.commits, _G.stats.maximize_changes);
+}
+
+/* Records a correction sent to the border of @extra and tells whether
+ * it has been corrected too often lately */
+static bool
+_watchdog_tripped(Border_Extra *extra)
+{
+    double now = ecore_loop_time_get();
+    double oldest;
+
+    extra->corrections[extra->correction] = now;
+    extra->correction = (extra->correction + 1) % TILING_WATCHDOG_COUNT;
+    /* The next slot holds the oldest correction */
+    oldest = extra->corrections[extra->correction];
+
+    return oldest > 0.0 && now - oldest < TILING_WATCHDOG_DELAY;
+}
+
+static void
+_watchdog_reset(Border_Extra *extra)
+{
+    memset(extra->corrections, 0, sizeof(extra->corrections));
+    extra->correction = 0;
+}
+
 static void
 _restore_border(E_Border *bd)
 {
@@ -416,95 +1086,1740 @@ _get_or_create_border_extra(E_Border *bd)
     return extra;
 }
 
-/* }}} */
-/* Overlays {{{*/
-
 static void
-_overlays_free_cb(void *data)
+_update_weight(Border_Extra *extra)
 {
-    Border_Extra *extra = data;
+    if (_G.tinfo->conf->use_rows)
+        extra->weight = extra->expected.w;
+    else
+        extra->weight = extra->expected.h;
+}
 
-    if (extra->overlay.obj) {
-        evas_object_del(extra->overlay.obj);
-        extra->overlay.obj = NULL;
-    }
-    if (extra->overlay.popup) {
-        e_object_del(E_OBJECT(extra->overlay.popup));
-        extra->overlay.popup = NULL;
-    }
+/* The border changed stack, let it take an average share of the new one */
+static void
+_forget_weight(E_Border *bd)
+{
+    Border_Extra *extra;
 
-    extra->key[0] = '\0';
+    extra = eina_hash_find(_G.border_extras, &bd);
+    if (extra)
+        extra->weight = 0;
 }
 
+/* After the user resized the border at @l, remember the new sizes of it
+ * and of its neighbours for the next layouts of the stack */
 static void
-end_special_input(void)
+_update_weights_around(Eina_List *l)
 {
-    if (_G.input_mode == INPUT_MODE_NONE)
-        return;
+    Eina_List *ls[3] = { l->prev, l, l->next };
 
-    if (_G.overlays) {
-        eina_hash_free(_G.overlays);
-        _G.overlays = NULL;
-    }
+    for (int i = 0; i < 3; i++) {
+        E_Border *bd;
+        Border_Extra *extra;
 
-    if (_G.handler_key) {
-        ecore_event_handler_del(_G.handler_key);
-        _G.handler_key = NULL;
-    }
-    if (_G.action_input_win) {
-        e_grabinput_release(_G.action_input_win, _G.action_input_win);
-        ecore_x_window_free(_G.action_input_win);
-        _G.action_input_win = 0;
-    }
-    if (_G.action_timer) {
-        ecore_timer_del(_G.action_timer);
-        _G.action_timer = NULL;
+        if (!ls[i])
+            continue;
+        bd = ls[i]->data;
+        extra = eina_hash_find(_G.border_extras, &bd);
+        if (extra)
+            _update_weight(extra);
     }
+}
 
-    _G.focused_bd = NULL;
-    _G.action_cb = NULL;
+/* }}} */
+/* Rules {{{*/
 
-    switch(_G.input_mode) {
-      case INPUT_MODE_MOVING:
-        for (int i = 0; i < MOVE_COUNT; i++) {
-            overlay_t *overlay = &_G.move_overlays[i];
+static bool
+_rule_matches(const struct _Config_rule *rule, const E_Border *bd)
+{
+#define _RULE_STR_MATCHES(_field, _value) \
+    (!rule->_field || ((_value) && !strcmp(rule->_field, _value)))
+
+    return _RULE_STR_MATCHES(class, bd->client.icccm.class)
+        && _RULE_STR_MATCHES(name, bd->client.icccm.name)
+        && _RULE_STR_MATCHES(role, bd->client.icccm.window_role)
+        && (!rule->type || (int)bd->client.netwm.type == rule->type);
+#undef _RULE_STR_MATCHES
+}
 
-            if (overlay->obj) {
-                evas_object_del(overlay->obj);
-                overlay->obj = NULL;
-            }
-            if (overlay->popup) {
-                e_object_del(E_OBJECT(overlay->popup));
-                overlay->popup = NULL;
-            }
-        }
-        break;
-      case INPUT_MODE_TRANSITION:
-        if (_G.transition_overlay) {
-            if (_G.transition_overlay->overlay.obj) {
-                evas_object_del(_G.transition_overlay->overlay.obj);
-            }
-            if (_G.transition_overlay->overlay.popup) {
-                e_object_del(E_OBJECT(_G.transition_overlay->overlay.popup));
-            }
-            E_FREE(_G.transition_overlay);
-            _G.transition_overlay = NULL;
-        }
-        break;
-      default:
-        break;
-    }
+static void
+_rules_list_free(void *data)
+{
+    eina_list_free(data);
+}
 
-    _G.input_mode = INPUT_MODE_NONE;
+static void
+_rules_free(void)
+{
+    if (_G.rules.by_class) {
+        eina_hash_free(_G.rules.by_class);
+        eina_hash_free(_G.rules.by_name);
+        eina_hash_free(_G.rules.by_role);
+        eina_hash_free(_G.rules.by_type);
+    }
+    _G.rules.by_class = _G.rules.by_name = NULL;
+    _G.rules.by_role = _G.rules.by_type = NULL;
+    E_FREE(_G.rules.all);
+    _G.rules.count = 0;
 }
 
-static Eina_Bool
-overlay_key_down(void *data,
-          int type,
-          void *event)
+/* Files every rule of the configuration under the first field it
+ * matches on, in order, so that finding the rules of a border takes
+ * one lookup per field whatever the number of rules */
+static void
+_rules_compile(void)
 {
-    Ecore_Event_Key *ev = event;
-    Border_Extra *extra;
+    _rules_free();
+
+    _G.rules.by_class = eina_hash_string_superfast_new(_rules_list_free);
+    _G.rules.by_name = eina_hash_string_superfast_new(_rules_list_free);
+    _G.rules.by_role = eina_hash_string_superfast_new(_rules_list_free);
+    _G.rules.by_type = eina_hash_int32_new(_rules_list_free);
+    _G.rules.all = E_NEW(rule_t, eina_list_count(tiling_g.config->rules));
+
+    for (Eina_List *l = tiling_g.config->rules; l; l = l->next) {
+        struct _Config_rule *rule = l->data;
+        rule_t *compiled;
+        Eina_Hash *hash;
+        const void *key;
+        Eina_List *list;
+
+        if (!rule)
+            continue;
+
+        if (rule->class) {
+            hash = _G.rules.by_class;
+            key = rule->class;
+        } else if (rule->name) {
+            hash = _G.rules.by_name;
+            key = rule->name;
+        } else if (rule->role) {
+            hash = _G.rules.by_role;
+            key = rule->role;
+        } else if (rule->type) {
+            hash = _G.rules.by_type;
+            key = &rule->type;
+        } else {
+            ERR("ignoring a rule matching every window");
+            continue;
+        }
+
+        compiled = &_G.rules.all[_G.rules.count];
+        compiled->conf = rule;
+        compiled->order = _G.rules.count++;
+
+        list = eina_hash_find(hash, key);
+        list = eina_list_append(list, compiled);
+        eina_hash_set(hash, key, list);
+    }
+}
+
+/* Returns the first rule of the configuration matching @bd, if any */
+static const struct _Config_rule *
+_rule_find(const E_Border *bd)
+{
+    const rule_t *found = NULL;
+    const Eina_List *lists[4];
+    int type = bd->client.netwm.type;
+
+    if (!_G.rules.count)
+        return NULL;
+
+    lists[0] = bd->client.icccm.class ?
+        eina_hash_find(_G.rules.by_class, bd->client.icccm.class) : NULL;
+    lists[1] = bd->client.icccm.name ?
+        eina_hash_find(_G.rules.by_name, bd->client.icccm.name) : NULL;
+    lists[2] = bd->client.icccm.window_role ?
+        eina_hash_find(_G.rules.by_role, bd->client.icccm.window_role) : NULL;
+    lists[3] = eina_hash_find(_G.rules.by_type, &type);
+
+    for (int i = 0; i < 4; i++) {
+        for (const Eina_List *l = lists[i]; l; l = l->next) {
+            const rule_t *rule = l->data;
+
+            if (!_rule_matches(rule->conf, bd))
+                continue;
+            /* Keep the one coming first in the configuration */
+            if (!found || rule->order < found->order)
+                found = rule;
+            break;
+        }
+    }
+
+    return found ? found->conf : NULL;
+}
+
+/* Returns the stack a rule wants @bd in, or -1 */
+static int
+_rule_stack(const E_Border *bd)
+{
+    const struct _Config_rule *rule = _rule_find(bd);
+
+    if (!rule || rule->action != TILING_RULE_STACK)
+        return -1;
+    if (rule->stack < 0 || rule->stack >= get_stack_count())
+        return -1;
+
+    return rule->stack;
+}
+
+/* Floats @bd if a rule says so. Only done when the module tiles windows
+ * by itself: toggle_floating can still tile it. */
+static bool
+_rule_float(E_Border *bd)
+{
+    const struct _Config_rule *rule = _rule_find(bd);
+
+    if (!rule || rule->action != TILING_RULE_FLOAT)
+        return false;
+    if (!is_floating_window(bd))
+        EINA_LIST_APPEND(_G.tinfo->floating_windows, bd);
+
+    return true;
+}
+
+/* }}} */
+/* Placement memory {{{*/
+
+static bool
+_placement_key(const char *class, const char *role,
+               int x, int y, unsigned int zone_num,
+               char *buf, size_t len)
+{
+    if (!class)
+        return false;
+
+    snprintf(buf, len, "%s\x1f%s\x1f%d,%d,%u",
+             class, role ? role : "", x, y, zone_num);
+    return true;
+}
+
+static void
+_placements_index(void)
+{
+    if (_G.placement_hash)
+        eina_hash_free(_G.placement_hash);
+    _G.placement_hash = eina_hash_string_superfast_new(NULL);
+
+    for (Eina_List *l = _G.placements->placements; l; l = l->next) {
+        struct _Config_placement *pl = l->data;
+        char key[PATH_MAX];
+
+        if (_placement_key(pl->class, pl->role, pl->x, pl->y, pl->zone_num,
+                           key, sizeof(key)))
+            eina_hash_set(_G.placement_hash, key, pl);
+    }
+}
+
+static void
+_placement_free(struct _Config_placement *pl)
+{
+    eina_stringshare_del(pl->class);
+    eina_stringshare_del(pl->role);
+    free(pl);
+}
+
+/* Returns where the last window of the class and role of @bd was tiled
+ * on its desk */
+static const struct _Config_placement *
+_placement_find(const E_Border *bd)
+{
+    char key[PATH_MAX];
+
+    if (!_G.placement_hash
+    ||  !_placement_key(bd->client.icccm.class, bd->client.icccm.window_role,
+                        bd->desk->x, bd->desk->y, bd->zone->num,
+                        key, sizeof(key)))
+        return NULL;
+
+    return eina_hash_find(_G.placement_hash, key);
+}
+
+static void
+_placements_save(void)
+{
+    if (!_G.placements_dirty)
+        return;
+    e_config_domain_save("module.e-tiling.placement", _G.placements_edd,
+                         _G.placements);
+    _G.placements_dirty = false;
+}
+
+static Eina_Bool
+_placements_save_cb(void *data)
+{
+    _G.placements_timer = NULL;
+    _placements_save();
+
+    return ECORE_CALLBACK_CANCEL;
+}
+
+/* Records where @bd is tiled, so that the next window of its class and
+ * role goes straight there. Saved a while later, once for all the
+ * windows closed meanwhile. */
+static void
+_placement_remember(E_Border *bd)
+{
+    struct _Config_placement *pl;
+    Border_Extra *extra;
+    char key[PATH_MAX];
+    int stack;
+
+    stack = get_stack(bd);
+    if (stack < 0 || !_G.placement_hash)
+        return;
+    if (!_placement_key(bd->client.icccm.class, bd->client.icccm.window_role,
+                        bd->desk->x, bd->desk->y, bd->zone->num,
+                        key, sizeof(key)))
+        return;
+
+    pl = eina_hash_find(_G.placement_hash, key);
+    if (pl) {
+        /* Most recently used last */
+        EINA_LIST_REMOVE(_G.placements->placements, pl);
+    } else {
+        pl = E_NEW(struct _Config_placement, 1);
+        pl->class = eina_stringshare_add(bd->client.icccm.class);
+        pl->role = eina_stringshare_add(bd->client.icccm.window_role);
+        pl->x = bd->desk->x;
+        pl->y = bd->desk->y;
+        pl->zone_num = bd->zone->num;
+        eina_hash_add(_G.placement_hash, key, pl);
+    }
+    EINA_LIST_APPEND(_G.placements->placements, pl);
+
+    extra = eina_hash_find(_G.border_extras, &bd);
+    pl->stack = stack;
+    pl->position = 0;
+    for (Eina_List *l = _G.tinfo->stacks[stack]; l && l->data != bd;
+         l = l->next)
+        pl->position++;
+    pl->weight = extra ? extra->weight : 0;
+
+    if (eina_list_count(_G.placements->placements) > TILING_PLACEMENT_MAX) {
+        struct _Config_placement *old = _G.placements->placements->data;
+
+        _G.placements->placements =
+            eina_list_remove_list(_G.placements->placements,
+                                  _G.placements->placements);
+        if (_placement_key(old->class, old->role,
+                           old->x, old->y, old->zone_num,
+                           key, sizeof(key)))
+            eina_hash_del_by_key(_G.placement_hash, key);
+        _placement_free(old);
+    }
+
+    _G.placements_dirty = true;
+    if (!_G.placements_timer)
+        _G.placements_timer = ecore_timer_add(TILING_PLACEMENT_SAVE_DELAY,
+                                              _placements_save_cb, NULL);
+}
+
+/* Puts @bd in @stack at @position, or last if @position is out of the
+ * stack */
+static void
+_stack_insert(int stack, E_Border *bd, int position)
+{
+    Eina_List *rel = NULL;
+
+    if (position >= 0)
+        rel = eina_list_nth_list(_G.tinfo->stacks[stack], position);
+    if (rel)
+        _G.tinfo->stacks[stack] =
+            eina_list_prepend_relative_list(_G.tinfo->stacks[stack], bd, rel);
+    else
+        EINA_LIST_APPEND(_G.tinfo->stacks[stack], bd);
+}
+
+/* }}} */
+/* Layout persistence {{{*/
+
+static void
+_layout_index(void)
+{
+    if (_G.layout_hash)
+        eina_hash_free(_G.layout_hash);
+    _G.layout_hash = eina_hash_int32_new(NULL);
+
+    for (Eina_List *l = _G.layout->windows; l; l = l->next) {
+        struct _Config_layout_window *lw = l->data;
+
+        eina_hash_set(_G.layout_hash, &lw->win, lw);
+    }
+}
+
+/* Returns where @bd was tiled when the layout was saved, if it is still
+ * on the same desk */
+static const struct _Config_layout_window *
+_layout_find(const E_Border *bd)
+{
+    const struct _Config_layout_window *lw;
+    unsigned int win = bd->client.win;
+
+    if (!_G.layout_hash)
+        return NULL;
+
+    lw = eina_hash_find(_G.layout_hash, &win);
+    if (!lw || lw->x != bd->desk->x || lw->y != bd->desk->y
+    ||  lw->zone_num != bd->zone->num)
+        return NULL;
+
+    return lw;
+}
+
+/* @bd has been put back in place: its saved layout is not needed anymore
+ * except for saving it again */
+static void
+_layout_forget(const E_Border *bd)
+{
+    unsigned int win = bd->client.win;
+
+    eina_hash_del_by_key(_G.layout_hash, &win);
+}
+
+static int
+_layout_cmp(const void *data1, const void *data2)
+{
+    const struct _Config_layout_window *lw1 = _layout_find(data1),
+                                       *lw2 = _layout_find(data2);
+
+    if (!lw1 || !lw2)
+        return !lw1 - !lw2;
+    if (lw1->stack != lw2->stack)
+        return lw1->stack - lw2->stack;
+    return lw1->position - lw2->position;
+}
+
+static Eina_Bool
+_layout_save_tinfo(const Eina_Hash *hash, const void *key,
+                   void *data, void *fdata)
+{
+    Tiling_Info *tinfo = data;
+    Eina_List **windows = fdata;
+
+    if (!tinfo->desk || !tinfo->conf)
+        return EINA_TRUE;
+
+    for (int i = 0; i < TILING_MAX_STACKS; i++) {
+        int position = 0;
+
+        for (Eina_List *l = tinfo->stacks[i]; l; l = l->next, position++) {
+            E_Border *bd = l->data;
+            struct _Config_layout_window *lw;
+            Border_Extra *extra;
+
+            extra = eina_hash_find(_G.border_extras, &bd);
+
+            lw = E_NEW(struct _Config_layout_window, 1);
+            lw->win = bd->client.win;
+            lw->x = tinfo->desk->x;
+            lw->y = tinfo->desk->y;
+            lw->zone_num = tinfo->desk->zone->num;
+            lw->stack = i;
+            lw->position = position;
+            lw->weight = extra ? extra->weight : 0;
+            lw->stack_size = tinfo->size[i];
+            *windows = eina_list_append(*windows, lw);
+        }
+    }
+
+    return EINA_TRUE;
+}
+
+/* Saves the stacks of every desk, by window id. Windows which were in
+ * the saved layout but have not been tiled again yet are kept as long
+ * as they exist */
+static void
+_layout_save(void)
+{
+    struct _Config_layout_window *lw;
+    Eina_List *windows = NULL,
+              *kept = NULL;
+
+    if (!_G.layout)
+        return;
+
+    EINA_LIST_FREE(_G.layout->windows, lw) {
+        if (eina_hash_find(_G.layout_hash, &lw->win)
+        &&  e_border_find_by_client_window(lw->win))
+            kept = eina_list_append(kept, lw);
+        else
+            free(lw);
+    }
+    eina_hash_free_buckets(_G.layout_hash);
+    for (Eina_List *l = kept; l; l = l->next) {
+        lw = l->data;
+        eina_hash_set(_G.layout_hash, &lw->win, lw);
+    }
+
+    eina_hash_foreach(_G.info_hash, _layout_save_tinfo, &windows);
+    _G.layout->windows = eina_list_merge(windows, kept);
+
+    e_config_domain_save("module.e-tiling.layout", _G.layout_edd, _G.layout);
+}
+
+/* }}} */
+/* Layout solver {{{*/
+
+/* Splits @total pixels between the spans of @count that are not @fixed,
+ * in proportion to their weight. Rounding leftovers go to the largest
+ * remainders so that the sizes of spans whose weights add up to @total
+ * are kept exactly. */
+static void
+_split_free_spans(int total, int count, const span_t *spans,
+                  const bool *fixed, int *sizes)
+{
+    double rests[count];
+    double sum = 0.0;
+    int nb_free = 0;
+    int used = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (fixed[i])
+            continue;
+        sum += spans[i].weight;
+        nb_free++;
+    }
+    if (!nb_free)
+        return;
+
+    for (int i = 0; i < count; i++) {
+        double exact;
+
+        if (fixed[i]) {
+            rests[i] = -1.0;
+            continue;
+        }
+
+        if (sum > 0.0)
+            exact = total * spans[i].weight / sum;
+        else
+            exact = (double)total / nb_free;
+
+        sizes[i] = (int)exact;
+        rests[i] = exact - sizes[i];
+        used += sizes[i];
+    }
+
+    while (used < total) {
+        int best = -1;
+
+        for (int i = 0; i < count; i++) {
+            if (fixed[i])
+                continue;
+            if (best < 0 || rests[i] > rests[best])
+                best = i;
+        }
+        sizes[best]++;
+        rests[best] = -1.0;
+        used++;
+    }
+}
+
+/* Splits @total pixels between @count spans in proportion to their
+ * weight, without going below the minimum or above the maximum of any
+ * of them. Spans that would break a bound are pinned to it and the
+ * rest of the room goes to the flexible ones, so that every client gets
+ * a size it accepts at once. */
+static void
+_fit_spans(int total, int count, const span_t *spans, int *sizes)
+{
+    bool fixed[count];
+    int sum_min = 0;
+    int left;
+
+    for (int i = 0; i < count; i++) {
+        fixed[i] = false;
+        sum_min += spans[i].min;
+    }
+
+    if (sum_min >= total) {
+        span_t mins[count];
+
+        /* Not enough room: squeeze every span in proportion to its
+         * minimum */
+        for (int i = 0; i < count; i++) {
+            mins[i] = spans[i];
+            mins[i].weight = spans[i].min;
+        }
+        _split_free_spans(total, count, mins, fixed, sizes);
+        return;
+    }
+
+    for (;;) {
+        double sum = 0.0, under = 0.0, over = 0.0;
+        int nb_free = 0;
+
+        left = total;
+        for (int i = 0; i < count; i++) {
+            if (fixed[i]) {
+                left -= sizes[i];
+            } else {
+                sum += spans[i].weight;
+                nb_free++;
+            }
+        }
+
+        if (!nb_free) {
+            int more[count];
+
+            /* Every span is pinned. What is left over is spread anyway,
+             * past the maximums, but when the minimums take more than
+             * the room the spans keep them and overflow it. */
+            if (left <= 0)
+                return;
+            for (int i = 0; i < count; i++) {
+                fixed[i] = false;
+                more[i] = 0;
+            }
+            _split_free_spans(left, count, spans, fixed, more);
+            for (int i = 0; i < count; i++) {
+                sizes[i] += more[i];
+            }
+            return;
+        }
+
+#define _SPAN_EXACT(_i) \
+        (sum > 0.0 ? left * spans[_i].weight / sum : (double)left / nb_free)
+        for (int i = 0; i < count; i++) {
+            double exact;
+
+            if (fixed[i])
+                continue;
+            exact = _SPAN_EXACT(i);
+            if (exact < spans[i].min)
+                under += spans[i].min - exact;
+            else if (spans[i].max && exact > spans[i].max)
+                over += exact - spans[i].max;
+        }
+        if (under <= 0.0 && over <= 0.0)
+            break;
+
+        /* Pin the side that is the most violated first, the other one
+         * may be fixed by doing so */
+        for (int i = 0; i < count; i++) {
+            double exact;
+
+            if (fixed[i])
+                continue;
+            exact = _SPAN_EXACT(i);
+            if (under >= over && exact < spans[i].min) {
+                fixed[i] = true;
+                sizes[i] = spans[i].min;
+            } else
+            if (under < over && spans[i].max && exact > spans[i].max) {
+                fixed[i] = true;
+                sizes[i] = spans[i].max;
+            }
+        }
+#undef _SPAN_EXACT
+    }
+
+    _split_free_spans(left, count, spans, fixed, sizes);
+}
+
+/* Rounds the sizes of spans with increments down to one they accept,
+ * and gives what is saved to the spans that take any size. Terminals
+ * then get the exact size they would have rounded themselves to. */
+static void
+_snap_spans(int count, const span_t *spans, int *sizes)
+{
+    bool fixed[count];
+    int rest = 0;
+    int any = -1;
+
+    for (int i = 0; i < count; i++) {
+        const span_t *span = &spans[i];
+        int snapped;
+
+        fixed[i] = true;
+        if (span->step <= 1) {
+            fixed[i] = span->max && sizes[i] >= span->max;
+            any = i;
+            continue;
+        }
+        if (sizes[i] <= span->base)
+            continue;
+
+        snapped = sizes[i] - (sizes[i] - span->base) % span->step;
+        if (snapped < span->min)
+            continue;
+        rest += sizes[i] - snapped;
+        sizes[i] = snapped;
+    }
+
+    while (rest > 0) {
+        int more[count];
+        int nb_free = 0;
+
+        for (int i = 0; i < count; i++) {
+            more[i] = 0;
+            if (!fixed[i])
+                nb_free++;
+        }
+        if (!nb_free)
+            break;
+
+        _split_free_spans(rest, count, spans, fixed, more);
+        rest = 0;
+        for (int i = 0; i < count; i++) {
+            if (fixed[i])
+                continue;
+            sizes[i] += more[i];
+            if (spans[i].max && sizes[i] >= spans[i].max) {
+                rest += sizes[i] - spans[i].max;
+                sizes[i] = spans[i].max;
+                fixed[i] = true;
+            }
+        }
+    }
+
+    /* Nobody can take it within its bounds. A span taking any size
+     * does not mind going over its maximum as much as a stepped one
+     * minds breaking its increment, which it would snap back from. */
+    if (rest > 0 && any >= 0) {
+        sizes[any] += rest;
+        return;
+    }
+
+    /* Only whole increments then, the remainder is left as a gap */
+    for (int i = count - 1; i >= 0 && rest > 0; i--) {
+        const span_t *span = &spans[i];
+        int steps;
+
+        if (span->step <= 1)
+            continue;
+        steps = rest / span->step;
+        if (span->max)
+            steps = MIN(steps, MAX(0, (span->max - sizes[i]) / span->step));
+        sizes[i] += steps * span->step;
+        rest -= steps * span->step;
+    }
+}
+
+/* Splits @total pixels between @count spans, honouring their bounds and
+ * their increments */
+static void
+_split_spans(int total, int count, const span_t *spans, int *sizes)
+{
+    _fit_spans(total, count, spans, sizes);
+    _snap_spans(count, spans, sizes);
+}
+
+/* Fills the bounds of @span with the size hints of @bd, along the
+ * horizontal axis if @horizontal is set. The sizes are those of the
+ * frame, as are the ones handed to e_border_move_resize() */
+static void
+_border_span(const E_Border *bd, bool horizontal, span_t *span)
+{
+    int inset, min, max, base, step;
+
+    if (horizontal) {
+        inset = bd->client_inset.l + bd->client_inset.r;
+        min = MAX(bd->client.icccm.min_w, bd->client.icccm.base_w);
+        max = bd->client.icccm.max_w;
+        base = bd->client.icccm.base_w;
+        step = bd->client.icccm.step_w;
+        /* ICCCM: the minimum size stands for an unset base size */
+        if (base <= 0)
+            base = bd->client.icccm.min_w;
+    } else {
+        inset = bd->client_inset.t + bd->client_inset.b;
+        min = MAX(bd->client.icccm.min_h, bd->client.icccm.base_h);
+        max = bd->client.icccm.max_h;
+        base = bd->client.icccm.base_h;
+        step = bd->client.icccm.step_h;
+        if (base <= 0)
+            base = bd->client.icccm.min_h;
+    }
+
+    span->base = MAX(base, 0) + inset;
+    span->step = step > 1 ? step : 0;
+    span->min = MAX(min, 1) + inset;
+    /* 32767 is what unset maximums default to */
+    if (max > 0 && max < 32767)
+        span->max = MAX(max + inset, span->min);
+    else
+        span->max = 0;
+}
+
+/* Fills the bounds of @span for a whole stack, across it: the stack has
+ * to be wide enough for every window in it, and is not made wider than
+ * what its narrowest window accepts. It only has increments when all
+ * of its windows share them. */
+static void
+_stack_span(const Eina_List *list, bool horizontal, span_t *span)
+{
+    span->min = 1;
+    span->max = 0;
+    span->base = 0;
+    span->step = 0;
+
+    for (const Eina_List *l = list; l; l = l->next) {
+        span_t bspan;
+
+        _border_span(l->data, horizontal, &bspan);
+        span->min = MAX(span->min, bspan.min);
+        if (bspan.max && (!span->max || bspan.max < span->max))
+            span->max = bspan.max;
+        if (l == list) {
+            span->base = bspan.base;
+            span->step = bspan.step;
+        } else
+        if (span->base != bspan.base || span->step != bspan.step) {
+            span->step = 0;
+        }
+    }
+    if (span->max && span->max < span->min)
+        span->max = span->min;
+}
+
+/* Returns @delta, clamped so that growing a span of @size_a by it and
+ * shrinking one of @size_b by as much keeps both within their bounds */
+static int
+_clamp_delta(const span_t *a, int size_a,
+             const span_t *b, int size_b, int delta)
+{
+    int lo, hi;
+
+    lo = a->min - size_a;
+    if (b->max)
+        lo = MAX(lo, size_b - b->max);
+    hi = size_b - b->min;
+    if (a->max)
+        hi = MIN(hi, a->max - size_a);
+
+    if (lo > hi)
+        return 0;
+    return MAX(lo, MIN(delta, hi));
+}
+
+/* Clamps @delta for moving the edge between two neighbours of a stack,
+ * @bd growing by it and @nextbd shrinking by as much */
+static int
+_clamp_border_delta(const E_Border *bd, int size,
+                    const E_Border *nextbd, int nextsize, int delta)
+{
+    bool horizontal = _G.tinfo->conf->use_rows;
+    span_t a, b;
+
+    _border_span(bd, horizontal, &a);
+    _border_span(nextbd, horizontal, &b);
+
+    return _clamp_delta(&a, size, &b, nextsize, delta);
+}
+
+/* Clamps @delta for moving the edge between two stacks, @stack growing
+ * by it and @nextstack shrinking by as much */
+static int
+_clamp_stack_delta(int stack, int nextstack, int delta)
+{
+    bool horizontal = !_G.tinfo->conf->use_rows;
+    span_t a, b;
+
+    _stack_span(_G.tinfo->stacks[stack], horizontal, &a);
+    _stack_span(_G.tinfo->stacks[nextstack], horizontal, &b);
+
+    return _clamp_delta(&a, _G.tinfo->size[stack],
+                        &b, _G.tinfo->size[nextstack], delta);
+}
+
+/* }}} */
+/* Overlays {{{*/
+
+/* Returns the canvas of the compositor, on which the overlays of @zone
+ * are drawn, or NULL when they need popups of their own */
+static Evas *
+_overlay_comp_evas(const E_Zone *zone)
+{
+    if (!e_config->use_composite)
+        return NULL;
+    return e_manager_comp_evas_get(zone->container->manager);
+}
+
+static void
+_overlay_forget(overlay_t *overlay, const Evas_Object *obj)
+{
+    if (overlay && overlay->obj == obj) {
+        overlay->popup = NULL;
+        overlay->obj = NULL;
+    }
+}
+
+static void
+_comp_lost_job(void *data)
+{
+    _G.comp_lost_job = NULL;
+    end_special_input();
+}
+
+/* Forgets @obj when the compositor deletes its canvas. If it is in use,
+ * the overlay holding it is emptied so that nothing touches it anymore,
+ * and the input mode is ended once the canvas is gone. */
+static void
+_comp_obj_del_cb(void *data, Evas *evas, Evas_Object *obj, void *event_info)
+{
+    Eina_List *spares = eina_hash_find(_G.comp_spares, &evas);
+
+    if (!eina_list_data_find(spares, obj)) {
+        for (int i = 0; i < _G.hints.nb_leaves; i++) {
+            _overlay_forget(_G.hints.overlays[i], obj);
+        }
+        for (int i = 0; i < MOVE_COUNT; i++) {
+            _overlay_forget(&_G.move_overlays[i], obj);
+        }
+        if (_G.transition_overlay)
+            _overlay_forget(&_G.transition_overlay->overlay, obj);
+        if (!_G.comp_lost_job)
+            _G.comp_lost_job = ecore_job_add(_comp_lost_job, NULL);
+        return;
+    }
+
+    spares = eina_list_remove(spares, obj);
+    if (spares)
+        eina_hash_modify(_G.comp_spares, &evas, spares);
+    else
+        eina_hash_del_by_key(_G.comp_spares, &evas);
+}
+
+static Evas_Object *
+_comp_obj_new(Evas *evas)
+{
+    Evas_Object *obj = edje_object_add(evas);
+
+    if (!obj)
+        return NULL;
+
+    evas_object_layer_set(obj, TILING_COMP_LAYER);
+    evas_object_pass_events_set(obj, EINA_TRUE);
+    evas_object_event_callback_add(obj, EVAS_CALLBACK_DEL,
+                                   _comp_obj_del_cb, NULL);
+    return obj;
+}
+
+static void
+_comp_spares_free_cb(void *data)
+{
+    Eina_List *spares = data;
+    Evas_Object *obj;
+
+    EINA_LIST_FREE(spares, obj) {
+        evas_object_event_callback_del(obj, EVAS_CALLBACK_DEL,
+                                       _comp_obj_del_cb);
+        evas_object_del(obj);
+    }
+}
+
+/* Makes a hidden popup of @zone, holding its edje object as data */
+static E_Popup *
+_overlay_popup_new(E_Zone *zone)
+{
+    E_Popup *popup = e_popup_new(zone, 0, 0, 1, 1);
+
+    if (!popup)
+        return NULL;
+
+    e_popup_layer_set(popup, TILING_POPUP_LAYER);
+    e_object_data_set(E_OBJECT(popup), edje_object_add(popup->evas));
+
+    return popup;
+}
+
+static void
+_overlay_popup_free(E_Popup *popup)
+{
+    evas_object_del(e_object_data_get(E_OBJECT(popup)));
+    e_object_del(E_OBJECT(popup));
+}
+
+static void
+_overlay_pool_free_cb(void *data)
+{
+    Eina_List *pool = data;
+    E_Popup *popup;
+
+    EINA_LIST_FREE(pool, popup) {
+        _overlay_popup_free(popup);
+    }
+}
+
+static void
+_hint_canvas_free_cb(void *data)
+{
+    hint_canvas_t *canvas = data;
+    Evas_Object *obj;
+
+    EINA_LIST_FREE(canvas->spares, obj) {
+        evas_object_del(obj);
+    }
+    e_object_del(E_OBJECT(canvas->popup));
+    free(canvas);
+}
+
+static Eina_Bool
+_dead_zone_collect(const Eina_Hash *hash, const void *key,
+                   void *data, void *fdata)
+{
+    const E_Zone *zone = *(const E_Zone **)key;
+    Eina_List **dead = fdata;
+
+    if (!_zone_exists(zone))
+        EINA_LIST_APPEND(*dead, zone);
+
+    return EINA_TRUE;
+}
+
+/* Frees the pooled popups and the hint canvas of the zones gone, which
+ * would otherwise be handed out to a new zone at the same address */
+static void
+_overlay_pools_purge(void)
+{
+    Eina_List *dead = NULL;
+    const E_Zone *zone;
+
+    eina_hash_foreach(_G.overlay_pool, _dead_zone_collect, &dead);
+    eina_hash_foreach(_G.hint_canvases, _dead_zone_collect, &dead);
+    if (!dead)
+        return;
+
+    /* Gives back the overlays in use, which may be among them */
+    end_special_input();
+    EINA_LIST_FREE(dead, zone) {
+        eina_hash_del_by_key(_G.overlay_pool, &zone);
+        eina_hash_del_by_key(_G.hint_canvases, &zone);
+    }
+}
+
+/* Returns the key hint canvas of @zone, making it if needed */
+static hint_canvas_t *
+_hint_canvas_get(E_Zone *zone)
+{
+    hint_canvas_t *canvas = eina_hash_find(_G.hint_canvases, &zone);
+
+    if (canvas)
+        return canvas;
+
+    canvas = E_NEW(hint_canvas_t, 1);
+    canvas->popup = e_popup_new(zone, 0, 0, zone->w, zone->h);
+    if (!canvas->popup) {
+        free(canvas);
+        return NULL;
+    }
+    e_popup_layer_set(canvas->popup, TILING_POPUP_LAYER);
+    e_popup_ignore_events_set(canvas->popup, 1);
+    /* Only the hints are to be seen */
+    if (e_config->use_composite)
+        ecore_evas_alpha_set(canvas->popup->ecore_evas, 1);
+    else
+        ecore_evas_shaped_set(canvas->popup->ecore_evas, 1);
+
+    eina_hash_add(_G.hint_canvases, &zone, canvas);
+    return canvas;
+}
+
+static Eina_Bool
+_overlay_pool_warm_cb(void *data)
+{
+    E_Container *con = e_container_current_get(e_manager_current_get());
+    Eina_List *l;
+    E_Zone *zone;
+
+    /* One popup or size per iteration, not to hold the main loop */
+    EINA_LIST_FOREACH(con->zones, l, zone) {
+        Evas *evas = _overlay_comp_evas(zone);
+        Eina_List *pool;
+        hint_canvas_t *canvas;
+        E_Popup *popup;
+
+        if (evas) {
+            Evas_Object *obj;
+
+            if (_overlay_sizes_warm(evas))
+                return ECORE_CALLBACK_RENEW;
+            pool = eina_hash_find(_G.comp_spares, &evas);
+            if (eina_list_count(pool) >= TILING_OVERLAY_POOL)
+                continue;
+
+            obj = _comp_obj_new(evas);
+            if (!obj)
+                break;
+            if (pool)
+                eina_hash_modify(_G.comp_spares, &evas,
+                                 eina_list_prepend(pool, obj));
+            else
+                eina_hash_add(_G.comp_spares, &evas,
+                              eina_list_prepend(NULL, obj));
+            return ECORE_CALLBACK_RENEW;
+        }
+
+        pool = eina_hash_find(_G.overlay_pool, &zone);
+        canvas = eina_hash_find(_G.hint_canvases, &zone);
+        if (!canvas) {
+            if (!_hint_canvas_get(zone))
+                break;
+            return ECORE_CALLBACK_RENEW;
+        }
+        if (_overlay_sizes_warm(canvas->popup->evas))
+            return ECORE_CALLBACK_RENEW;
+        if (eina_list_count(pool) >= TILING_OVERLAY_POOL)
+            continue;
+
+        popup = _overlay_popup_new(zone);
+        if (!popup)
+            break;
+        pool = eina_list_prepend(pool, popup);
+        eina_hash_set(_G.overlay_pool, &zone, pool);
+        return ECORE_CALLBACK_RENEW;
+    }
+
+    _G.overlay_pool_idler = NULL;
+    return ECORE_CALLBACK_CANCEL;
+}
+
+/* Fills the pools again when the main loop is idle */
+static void
+_overlay_pool_warm(void)
+{
+    if (!_G.overlay_pool_idler)
+        _G.overlay_pool_idler = ecore_idler_add(_overlay_pool_warm_cb, NULL);
+}
+
+/* Sets @overlay to a hidden popup of @zone and its edje object, taken
+ * from the pool of the zone so that showing overlays does not create
+ * any. When compositing, @overlay is only an object drawn by the
+ * compositor above the windows. The caller sets its theme group with
+ * _overlay_type_set(). */
+static bool
+_overlay_acquire(overlay_t *overlay, E_Zone *zone)
+{
+    Evas *evas = _overlay_comp_evas(zone);
+    Eina_List *pool;
+
+    overlay->zone = zone;
+    overlay->shared = false;
+    if (evas) {
+        pool = eina_hash_find(_G.comp_spares, &evas);
+        overlay->popup = NULL;
+        if (pool) {
+            overlay->obj = pool->data;
+            pool = eina_list_remove_list(pool, pool);
+            if (pool)
+                eina_hash_modify(_G.comp_spares, &evas, pool);
+            else
+                eina_hash_del_by_key(_G.comp_spares, &evas);
+        } else {
+            overlay->obj = _comp_obj_new(evas);
+            _overlay_pool_warm();
+        }
+        return overlay->obj != NULL;
+    }
+
+    pool = eina_hash_find(_G.overlay_pool, &zone);
+    if (pool) {
+        overlay->popup = pool->data;
+        pool = eina_list_remove_list(pool, pool);
+        if (pool)
+            eina_hash_modify(_G.overlay_pool, &zone, pool);
+        else
+            eina_hash_del_by_key(_G.overlay_pool, &zone);
+    } else {
+        overlay->popup = _overlay_popup_new(zone);
+        if (!overlay->popup) {
+            overlay->obj = NULL;
+            return false;
+        }
+        _overlay_pool_warm();
+    }
+    overlay->obj = e_object_data_get(E_OBJECT(overlay->popup));
+
+    return true;
+}
+
+/* Hides @overlay and gives it back to the pool of its zone */
+static void
+_overlay_release(overlay_t *overlay)
+{
+    E_Zone *zone = overlay->zone;
+    Eina_List *pool;
+
+    if (!overlay->obj)
+        return;
+
+    evas_object_hide(overlay->obj);
+    if (!overlay->popup) {
+        Evas *evas = evas_object_evas_get(overlay->obj);
+
+        e_manager_comp_evas_update(zone->container->manager);
+        pool = eina_hash_find(_G.comp_spares, &evas);
+        if (pool)
+            eina_hash_modify(_G.comp_spares, &evas,
+                             eina_list_prepend(pool, overlay->obj));
+        else
+            eina_hash_add(_G.comp_spares, &evas,
+                          eina_list_prepend(NULL, overlay->obj));
+    } else {
+        e_popup_hide(overlay->popup);
+        pool = eina_hash_find(_G.overlay_pool, &zone);
+        if (pool)
+            eina_hash_modify(_G.overlay_pool, &zone,
+                             eina_list_prepend(pool, overlay->popup));
+        else
+            eina_hash_add(_G.overlay_pool, &zone,
+                          eina_list_prepend(NULL, overlay->popup));
+    }
+
+    overlay->popup = NULL;
+    overlay->obj = NULL;
+}
+
+/* Themes the object of @overlay for @type, and shapes its popup after
+ * it if it has one of its own */
+static void
+_overlay_type_set(overlay_t *overlay, overlay_type_t type)
+{
+    _overlay_theme_set(overlay->obj, type);
+    if (overlay->popup && !overlay->shared)
+        e_popup_edje_bg_object_set(overlay->popup, overlay->obj);
+}
+
+/* Places @overlay at @x, @y in its zone, sized @w x @h */
+static void
+_overlay_geometry_set(overlay_t *overlay, int x, int y, int w, int h)
+{
+    if (!overlay->popup)
+        evas_object_move(overlay->obj, overlay->zone->x + x,
+                         overlay->zone->y + y);
+    else if (overlay->shared)
+        evas_object_move(overlay->obj, x, y);
+    else
+        e_popup_move_resize(overlay->popup, x, y, w, h);
+    evas_object_resize(overlay->obj, w, h);
+    if (!overlay->popup)
+        e_manager_comp_evas_update(overlay->zone->container->manager);
+}
+
+static void
+_overlay_move_by(overlay_t *overlay, int dx, int dy)
+{
+    Evas_Coord x, y;
+
+    if (overlay->popup && !overlay->shared) {
+        e_popup_move(overlay->popup, overlay->popup->x + dx,
+                     overlay->popup->y + dy);
+        return;
+    }
+    evas_object_geometry_get(overlay->obj, &x, &y, NULL, NULL);
+    evas_object_move(overlay->obj, x + dx, y + dy);
+    if (!overlay->popup)
+        e_manager_comp_evas_update(overlay->zone->container->manager);
+}
+
+/* Shows or hides @overlay. Hints on a canvas are seen once the canvas
+ * is, see _hint_canvas_show(). */
+static void
+_overlay_visible_set(overlay_t *overlay, bool visible)
+{
+    if (!overlay || !overlay->obj)
+        return;
+
+    if (visible)
+        evas_object_show(overlay->obj);
+    else
+        evas_object_hide(overlay->obj);
+    if (!overlay->popup) {
+        e_manager_comp_evas_update(overlay->zone->container->manager);
+    } else if (!overlay->shared) {
+        if (visible)
+            e_popup_show(overlay->popup);
+        else
+            e_popup_hide(overlay->popup);
+    }
+}
+
+/* Sets @overlay to a hidden hint object on the canvas of @zone. Its
+ * popup is the one of the canvas, shared with the other hints. When
+ * compositing, it is drawn by the compositor as any other overlay. */
+static bool
+_hint_acquire(overlay_t *overlay, E_Zone *zone)
+{
+    hint_canvas_t *canvas;
+
+    if (_overlay_comp_evas(zone))
+        return _overlay_acquire(overlay, zone);
+
+    canvas = _hint_canvas_get(zone);
+    if (!canvas)
+        return false;
+
+    if (canvas->spares) {
+        overlay->obj = canvas->spares->data;
+        canvas->spares = eina_list_remove_list(canvas->spares,
+                                               canvas->spares);
+    } else {
+        overlay->obj = edje_object_add(canvas->popup->evas);
+    }
+    overlay->popup = canvas->popup;
+    overlay->zone = zone;
+    overlay->shared = true;
+    canvas->used++;
+
+    return true;
+}
+
+/* Shows at once every hint put on the canvas of @zone */
+static void
+_hint_canvas_show(E_Zone *zone)
+{
+    hint_canvas_t *canvas = eina_hash_find(_G.hint_canvases, &zone);
+
+    if (!canvas || !canvas->used)
+        return;
+
+    e_popup_move_resize(canvas->popup, 0, 0, zone->w, zone->h);
+    e_popup_show(canvas->popup);
+}
+
+static void
+_hint_release(overlay_t *overlay)
+{
+    hint_canvas_t *canvas;
+    E_Zone *zone;
+
+    if (!overlay->popup) {
+        _overlay_release(overlay);
+        return;
+    }
+
+    zone = overlay->zone;
+    canvas = eina_hash_find(_G.hint_canvases, &zone);
+    evas_object_hide(overlay->obj);
+    canvas->spares = eina_list_prepend(canvas->spares, overlay->obj);
+    if (--canvas->used <= 0)
+        e_popup_hide(canvas->popup);
+
+    overlay->popup = NULL;
+    overlay->obj = NULL;
+}
+
+/* Key hints {{{*/
+
+static void
+_hints_free(void)
+{
+    E_FREE(_G.hints.nodes);
+    E_FREE(_G.hints.leaves);
+    E_FREE(_G.hints.item_leaf);
+    E_FREE(_G.hints.data);
+    E_FREE(_G.hints.overlays);
+    _G.hints.nb_nodes = 0;
+    _G.hints.nb_leaves = 0;
+    _G.hints.current = 0;
+}
+
+static void
+_usage_decay(Border_Extra *extra, double now)
+{
+    int periods = (now - extra->usage_time) / TILING_USAGE_HALFLIFE;
+
+    if (periods <= 0)
+        return;
+    if (periods >= 32) {
+        extra->usage = 0.0;
+        extra->usage_time = now;
+    } else {
+        extra->usage /= 1U << periods;
+        extra->usage_time += periods * TILING_USAGE_HALFLIFE;
+    }
+}
+
+/* The window of @extra has just been used */
+static void
+_usage_bump(Border_Extra *extra)
+{
+    _usage_decay(extra, ecore_time_get());
+    extra->usage += 1.0;
+}
+
+/* Weight of the window of @extra for its hint: its usage rounded up to
+ * a power of two, so that hints do not change on every use */
+static unsigned int
+_usage_weight(Border_Extra *extra, double now)
+{
+    unsigned int usage, weight = 1;
+
+    _usage_decay(extra, now);
+    for (usage = extra->usage; usage && weight < (1U << 30); usage >>= 1)
+        weight <<= 1;
+
+    return weight;
+}
+
+/* A hint to make, see _hints_lengths() */
+typedef struct hint_item_t {
+    unsigned int weight;
+    unsigned int id;
+    int item;
+    int len;
+} hint_item_t;
+
+static int
+_hint_item_weight_cmp(const void *data1, const void *data2)
+{
+    const hint_item_t *a = data1, *b = data2;
+
+    if (a->weight != b->weight)
+        return a->weight < b->weight ? -1 : 1;
+    if (a->id != b->id)
+        return a->id < b->id ? -1 : 1;
+    return a->item - b->item;
+}
+
+static int
+_hint_item_len_cmp(const void *data1, const void *data2)
+{
+    const hint_item_t *a = data1, *b = data2;
+
+    if (a->len != b->len)
+        return a->len - b->len;
+    if (a->id != b->id)
+        return a->id < b->id ? -1 : 1;
+    return a->item - b->item;
+}
+
+/* Sets the code length of the @n @items as in a Huffman code over the
+ * keyhints alphabet, merging the lightest nodes first. Returns the
+ * length of the longest code. */
+static int
+_hints_lengths(int n, hint_item_t *items)
+{
+    int k = _G.hints.nb_symbols;
+    unsigned long long *weights;
+    int *parents, *depths;
+    int a = 0, b = n, next = n, left = n;
+    int longest = 0;
+
+    if (n == 1) {
+        items[0].len = 1;
+        return 1;
+    }
+
+    weights = E_NEW(unsigned long long, 2 * n);
+    parents = E_NEW(int, 2 * n);
+    depths = E_NEW(int, 2 * n);
+
+    qsort(items, n, sizeof(*items), _hint_item_weight_cmp);
+    for (int i = 0; i < n; i++) {
+        weights[i] = items[i].weight;
+    }
+
+    /* Leaves and merged nodes both come in increasing weight, the
+     * lightest of both queues is taken. The first merge takes fewer
+     * nodes so that the last one takes k. */
+    for (int m = 2 + (n - 2) % (k - 1); left > 1; m = k) {
+        weights[next] = 0;
+        for (int i = 0; i < m; i++) {
+            int node;
+
+            if (a < n && (b == next || weights[a] <= weights[b]))
+                node = a++;
+            else
+                node = b++;
+            parents[node] = next;
+            weights[next] += weights[node];
+        }
+        next++;
+        left -= m - 1;
+    }
+
+    depths[next - 1] = 0;
+    for (int node = next - 2; node >= 0; node--) {
+        depths[node] = depths[parents[node]] + 1;
+    }
+    for (int i = 0; i < n; i++) {
+        items[i].len = depths[i];
+        longest = MAX(longest, depths[i]);
+    }
+
+    free(weights);
+    free(parents);
+    free(depths);
+
+    return longest;
+}
+
+/* Makes the nodes below @node for the codes of @items[@lo..@hi), which
+ * share their first @depth digits */
+static void
+_hints_fill(int node, const hint_item_t *items,
+            unsigned char (*codes)[TILING_HINT_LEN],
+            int lo, int hi, int depth)
+{
+    hint_node_t *hn = &_G.hints.nodes[node];
+
+    hn->first = lo;
+    hn->count = hi - lo;
+
+    if (items[lo].len == depth) {
+        hn->child = -1;
+        _G.hints.leaves[lo] = node;
+        _G.hints.item_leaf[items[lo].item] = lo;
+        return;
+    }
+
+    /* Canonical codes use the first digits of every node */
+    hn->nb_children = codes[hi - 1][depth] + 1;
+    hn->child = _G.hints.nb_nodes;
+    _G.hints.nb_nodes += hn->nb_children;
+
+    for (int i = lo, digit = 0; digit < hn->nb_children; digit++) {
+        int j = i;
+        int child = _G.hints.nodes[node].child + digit;
+
+        while (j < hi && codes[j][depth] == digit)
+            j++;
+        _G.hints.nodes[child].parent = node;
+        _hints_fill(child, items, codes, i, j, depth + 1);
+        i = j;
+    }
+}
+
+/* Makes a trie of @n key hints from the characters of the keyhints
+ * setting, as a Huffman code: the larger @weights[i], the shorter the
+ * code of the i-th hint. Without @weights, every hint weighs the same
+ * and codes are as short as they can be.
+ * Codes are handed out in canonical order, by length then by @ids[i],
+ * so that a hint keeps its code as long as the code lengths stay the
+ * same. Returns the number of hints, which is @n unless it is too large
+ * for TILING_HINT_LEN. */
+static int
+_hints_build(int n, const unsigned int *weights, const unsigned int *ids)
+{
+    const char *keyhints = tiling_g.config->keyhints;
+    unsigned char (*codes)[TILING_HINT_LEN];
+    hint_item_t *items;
+
+    _hints_free();
+
+    _G.hints.nb_symbols = 0;
+    for (int i = 0; i < 256; i++) {
+        _G.hints.index[i] = -1;
+    }
+    for (int pass = 0; pass < 2 && _G.hints.nb_symbols < 2; pass++) {
+        if (pass)
+            keyhints = tiling_g.default_keyhints;
+        _G.hints.nb_symbols = 0;
+        for (const char *c = keyhints; c && *c; c++) {
+            unsigned char u = *c;
+
+            if (_G.hints.index[u] >= 0)
+                continue;
+            _G.hints.index[u] = _G.hints.nb_symbols;
+            _G.hints.symbols[_G.hints.nb_symbols++] = *c;
+        }
+    }
+
+    /* Two symbols at least: codes of the same weight are no longer than
+     * log2(n) */
+    n = MIN(n, 1 << (TILING_HINT_LEN - 1));
+    if (n <= 0)
+        return 0;
+
+    items = E_NEW(hint_item_t, n);
+    for (int i = 0; i < n; i++) {
+        items[i].weight = weights ? MAX(weights[i], 1) : 1;
+        items[i].id = ids ? ids[i] : (unsigned int)i;
+        items[i].item = i;
+    }
+    if (_hints_lengths(n, items) >= TILING_HINT_LEN) {
+        /* Too skewed: fall back to codes of the same length */
+        for (int i = 0; i < n; i++) {
+            items[i].weight = 1;
+        }
+        _hints_lengths(n, items);
+    }
+    qsort(items, n, sizeof(*items), _hint_item_len_cmp);
+
+    /* Canonical code: the next code of the same length, padded with
+     * zeros when getting longer */
+    codes = calloc(n, sizeof(*codes));
+    for (int i = 1; i < n; i++) {
+        int d = items[i - 1].len - 1;
+
+        memcpy(codes[i], codes[i - 1], sizeof(*codes));
+        while (d > 0 && codes[i][d] == _G.hints.nb_symbols - 1)
+            codes[i][d--] = 0;
+        codes[i][d]++;
+    }
+
+    _G.hints.nodes = E_NEW(hint_node_t, 2 * n + 1);
+    _G.hints.leaves = E_NEW(int, n);
+    _G.hints.item_leaf = E_NEW(int, n);
+    _G.hints.data = E_NEW(void *, n);
+    _G.hints.overlays = E_NEW(overlay_t *, n);
+    _G.hints.nodes[0].parent = -1;
+    _G.hints.nb_nodes = 1;
+    _hints_fill(0, items, codes, 0, n, 0);
+    _G.hints.nb_leaves = n;
+    _G.hints.current = 0;
+
+    free(codes);
+    free(items);
+
+    return n;
+}
+
+/* Writes the code of the @i-th hint in @key, of TILING_HINT_LEN bytes */
+static void
+_hints_code(int i, char *key)
+{
+    int leaf = _G.hints.leaves[_G.hints.item_leaf[i]];
+    int len = 0;
+
+    for (int node = leaf; node > 0; node = _G.hints.nodes[node].parent) {
+        len++;
+    }
+    key[len] = '\0';
+    for (int node = leaf; node > 0; node = _G.hints.nodes[node].parent) {
+        const hint_node_t *parent = &_G.hints.nodes[_G.hints.nodes[node].parent];
+
+        key[--len] = _G.hints.symbols[node - parent->child];
+    }
+}
+
+/* Ties @data, shown by @overlay, to the @i-th hint */
+static void
+_hints_set(int i, void *data, overlay_t *overlay)
+{
+    _G.hints.data[_G.hints.item_leaf[i]] = data;
+    _G.hints.overlays[_G.hints.item_leaf[i]] = overlay;
+}
+
+/* Shows the hints of the leaves below @node, and hides the other ones
+ * that were below @old */
+static void
+_hints_narrow(int old, int node)
+{
+    const hint_node_t *from = &_G.hints.nodes[old],
+                      *to = &_G.hints.nodes[node];
+
+    for (int i = from->first; i < from->first + from->count; i++) {
+        _overlay_visible_set(_G.hints.overlays[i],
+                          i >= to->first && i < to->first + to->count);
+    }
+    for (int i = to->first; i < to->first + to->count; i++) {
+        _overlay_visible_set(_G.hints.overlays[i], true);
+    }
+    _G.hints.current = node;
+}
+
+/* Goes on with the typed hint by @c. Returns the data of the only hint
+ * left, if any. Characters going nowhere are ignored. */
+static void *
+_hints_feed(char c)
+{
+    const hint_node_t *hn = &_G.hints.nodes[_G.hints.current];
+    int sym = _G.hints.index[(unsigned char)c];
+
+    if (!_G.hints.nb_leaves || hn->child < 0
+    ||  sym < 0 || sym >= hn->nb_children)
+        return NULL;
+
+    _hints_narrow(_G.hints.current, hn->child + sym);
+    hn = &_G.hints.nodes[_G.hints.current];
+
+    return hn->count == 1 ? _G.hints.data[hn->first] : NULL;
+}
+
+/* Forgets the last typed character */
+static void
+_hints_back(void)
+{
+    int parent;
+
+    if (!_G.hints.nb_leaves || !_G.hints.current)
+        return;
+
+    parent = _G.hints.nodes[_G.hints.current].parent;
+    _hints_narrow(parent, parent);
+}
+
+/* }}} */
+
+static void
+_overlays_free_cb(void *data)
+{
+    Border_Extra *extra = data;
+
+    _hint_release(&extra->overlay);
+
+    extra->key[0] = '\0';
+}
+
+static void
+end_special_input(void)
+{
+    if (_G.comp_lost_job) {
+        ecore_job_del(_G.comp_lost_job);
+        _G.comp_lost_job = NULL;
+    }
+
+    if (_G.input_mode == INPUT_MODE_NONE)
+        return;
+
+    if (_G.overlays) {
+        eina_hash_free(_G.overlays);
+        _G.overlays = NULL;
+    }
+    _hints_free();
+
+    if (_G.handler_key) {
+        ecore_event_handler_del(_G.handler_key);
+        _G.handler_key = NULL;
+    }
+    if (_G.action_input_win) {
+        e_grabinput_release(_G.action_input_win, _G.action_input_win);
+        ecore_x_window_free(_G.action_input_win);
+        _G.action_input_win = 0;
+    }
+    if (_G.action_timer) {
+        ecore_timer_del(_G.action_timer);
+        _G.action_timer = NULL;
+    }
+
+    _G.focused_bd = NULL;
+    _G.action_cb = NULL;
+
+    switch(_G.input_mode) {
+      case INPUT_MODE_MOVING:
+        for (int i = 0; i < MOVE_COUNT; i++) {
+            _overlay_release(&_G.move_overlays[i]);
+        }
+        break;
+      case INPUT_MODE_TRANSITION:
+        _transition_adjust_flush();
+        _G.adjust.direction = MOVE_COUNT;
+        _G.adjust.timestamp = 0;
+        _G.adjust.repeats = 0;
+        if (_G.transition_overlay) {
+            _overlay_release(&_G.transition_overlay->overlay);
+            E_FREE(_G.transition_overlay);
+            _G.transition_overlay = NULL;
+        }
+        break;
+      default:
+        break;
+    }
+
+    _G.input_mode = INPUT_MODE_NONE;
+}
+
+static Eina_Bool
+overlay_key_down(void *data,
+          int type,
+          void *event)
+{
+    Ecore_Event_Key *ev = event;
+    Border_Extra *extra;
 
     if (ev->event_window != _G.action_input_win)
         return ECORE_CALLBACK_PASS_ON;
@@ -513,26 +2828,15 @@ overlay_key_down(void *data,
         goto stop;
     if (strcmp(ev->key, "Escape") == 0)
         goto stop;
-    if (strcmp(ev->key, "Backspace") == 0) {
-        char *key = _G.keys;
-
-        while (*key)
-            key++;
-        *key = '\0';
+    if (strcmp(ev->key, "BackSpace") == 0) {
+        _hints_back();
         return ECORE_CALLBACK_RENEW;
     }
 
-    if (ev->key[0] && !ev->key[1] && strchr(tiling_g.config->keyhints,
-                                            ev->key[1])) {
-        char *key = _G.keys;
-
-        while (*key)
-            key++;
-        *key++ = ev->key[0];
-        *key = '\0';
-
-        extra = eina_hash_find(_G.overlays, _G.keys);
+    if (ev->string && ev->string[0] && !ev->string[1]) {
+        extra = _hints_feed(ev->string[0]);
         if (extra) {
+            _usage_bump(extra);
             _G.action_cb(_G.focused_bd, extra);
         } else {
             return ECORE_CALLBACK_RENEW;
@@ -558,8 +2862,6 @@ _do_overlay(E_Border *focused_bd,
 {
     Ecore_X_Window parent;
     int nb_win;
-    int hints_len;
-    int key_len;
     int n = 0;
     int nmax;
 
@@ -577,90 +2879,62 @@ _do_overlay(E_Border *focused_bd,
 
     _G.overlays = eina_hash_string_small_new(_overlays_free_cb);
 
-    hints_len = strlen(tiling_g.config->keyhints);
-    key_len = 1;
-    nmax = hints_len;
-    if (hints_len < nb_win) {
-        key_len = 2;
-        nmax *= hints_len;
-        if (hints_len * hints_len < nb_win) {
-            key_len = 3;
-            nmax *= hints_len;
-        }
-    }
+    {
+        Border_Extra *extras[nb_win];
+        unsigned int weights[nb_win], ids[nb_win];
+        double now = ecore_time_get();
 
-    for (int i = 0; i < TILING_MAX_STACKS; i++) {
-        Eina_List *l;
-        E_Border *bd;
+        for (int i = 0; i < TILING_MAX_STACKS; i++) {
+            Eina_List *l;
+            E_Border *bd;
 
-        if (!_G.tinfo->stacks[i])
-            break;
-        EINA_LIST_FOREACH(_G.tinfo->stacks[i], l, bd) {
-            if (bd != focused_bd && n < nmax) {
+            if (!_G.tinfo->stacks[i])
+                break;
+            EINA_LIST_FOREACH(_G.tinfo->stacks[i], l, bd) {
                 Border_Extra *extra;
-                Evas_Coord ew, eh;
 
+                if (bd == focused_bd)
+                    continue;
                 extra = eina_hash_find(_G.border_extras, &bd);
                 if (!extra) {
                     ERR("No extra for %p", bd);
                     continue;
                 }
+                extras[n] = extra;
+                weights[n] = _usage_weight(extra, now);
+                ids[n] = bd->client.win;
+                n++;
+            }
+        }
+        nmax = _hints_build(n, weights, ids);
 
-                extra->overlay.popup = e_popup_new(bd->zone, 0, 0, 1, 1);
-                if (!extra->overlay.popup)
-                    continue;
+        for (int i = 0; i < nmax; i++) {
+            Border_Extra *extra = extras[i];
+            E_Border *bd = extra->border;
+            Evas_Coord ew, eh;
 
-                e_popup_layer_set(extra->overlay.popup, TILING_POPUP_LAYER);
-                extra->overlay.obj =
-                    edje_object_add(extra->overlay.popup->evas);
-                e_theme_edje_object_set(extra->overlay.obj,
-                                        "base/theme/borders",
-                                        "e/widgets/border/default/resize");
-
-                switch (key_len) {
-                  case 1:
-                    extra->key[0] = tiling_g.config->keyhints[n];
-                    extra->key[1] = '\0';
-                    break;
-                  case 2:
-                    extra->key[0] = tiling_g.config->keyhints[n / hints_len];
-                    extra->key[1] = tiling_g.config->keyhints[n % hints_len];
-                    extra->key[2] = '\0';
-                    break;
-                  case 3:
-                    extra->key[0] = tiling_g.config->keyhints[n / hints_len / hints_len];
-                    extra->key[0] = tiling_g.config->keyhints[n / hints_len];
-                    extra->key[1] = tiling_g.config->keyhints[n % hints_len];
-                    extra->key[2] = '\0';
-                    break;
-                }
-                n++;
+            if (!_hint_acquire(&extra->overlay, bd->zone))
+                continue;
 
-                eina_hash_add(_G.overlays, extra->key, extra);
-                edje_object_part_text_set(extra->overlay.obj,
-                                          "e.text.label",
-                                          extra->key);
-                edje_object_size_min_calc(extra->overlay.obj, &ew, &eh);
-                evas_object_move(extra->overlay.obj, 0, 0);
-                evas_object_resize(extra->overlay.obj, ew, eh);
-                evas_object_show(extra->overlay.obj);
-                e_popup_edje_bg_object_set(extra->overlay.popup,
-                                           extra->overlay.obj);
-
-                evas_object_show(extra->overlay.obj);
-                e_popup_show(extra->overlay.popup);
-
-                e_popup_move_resize(extra->overlay.popup,
-                                    (bd->x - extra->overlay.popup->zone->x) +
-                                    ((bd->w - ew) / 2),
-                                    (bd->y - extra->overlay.popup->zone->y) +
-                                    ((bd->h - eh) / 2),
-                                    ew, eh);
-
-                e_popup_show(extra->overlay.popup);
-            }
+            _overlay_type_set(&extra->overlay, OVERLAY_HINT);
+
+            _hints_code(i, extra->key);
+            _hints_set(i, extra, &extra->overlay);
+
+            eina_hash_add(_G.overlays, extra->key, extra);
+            edje_object_part_text_set(extra->overlay.obj,
+                                      "e.text.label",
+                                      extra->key);
+            _overlay_size_get(extra->overlay.obj, OVERLAY_HINT, extra->key,
+                              &ew, &eh);
+            _overlay_geometry_set(&extra->overlay,
+                                  (bd->x - bd->zone->x) + ((bd->w - ew) / 2),
+                                  (bd->y - bd->zone->y) + ((bd->h - eh) / 2),
+                                  ew, eh);
+            _overlay_visible_set(&extra->overlay, true);
         }
     }
+    _hint_canvas_show(_G.tinfo->desk->zone);
 
     /* Get input */
     parent = _G.tinfo->desk->zone->container->win;
@@ -678,7 +2952,6 @@ _do_overlay(E_Border *focused_bd,
     _G.action_timer = ecore_timer_add(TILING_OVERLAY_TIMEOUT,
                                       _timeout_cb, NULL);
 
-    _G.keys[0] = '\0';
     _G.handler_key = ecore_event_handler_add(ECORE_EVENT_KEY_DOWN,
                                              overlay_key_down, NULL);
 }
@@ -686,151 +2959,166 @@ _do_overlay(E_Border *focused_bd,
 /* }}} */
 /* Reorganize Stacks {{{*/
 
+/* Computes the geometry of @count windows of @spans laid out one after
+ * the other in a stack at @pos of @size, in a zone whose useful
+ * geometry is @zone. @lonely is set for the only window of the desk,
+ * which then takes the whole zone. Uses no global state, so that it can
+ * run on a worker thread. */
 static void
-_reorganize_stack(int stack)
+_spans_layout(const geom_t *zone, bool use_rows, int count, span_t *spans,
+              int pos, int size, bool lonely, geom_t *geoms)
 {
-    if (stack < 0 || stack >= TILING_MAX_STACKS
-        || !_G.tinfo->stacks[stack])
+    int sizes[MAX(count, 1)];
+    double known = 0.0;
+    int nb_known = 0;
+
+    if (lonely) {
+        geoms[0] = *zone;
         return;
+    }
 
-    if (_G.tinfo->stacks[stack]->next) {
-        int zx, zy, zw, zh, i = 0, count;
+    for (int i = 0; i < count; i++) {
+        if (spans[i].weight > 0) {
+            known += spans[i].weight;
+            nb_known++;
+        }
+    }
+    /* New windows take an average share */
+    for (int i = 0; i < count; i++) {
+        if (spans[i].weight <= 0)
+            spans[i].weight = nb_known ? known / nb_known : 1.0;
+    }
 
-        e_zone_useful_geometry_get(_G.tinfo->desk->zone, &zx, &zy, &zw, &zh);
+    _split_spans(use_rows ? zone->w : zone->h, count, spans, sizes);
 
-        count = eina_list_count(_G.tinfo->stacks[stack]);
+    if (use_rows) {
+        int x = zone->x;
 
-        if (_G.tinfo->conf->use_rows) {
-            int y, w, h, cw;
+        for (int i = 0; i < count; i++) {
+            geoms[i].x = x;
+            geoms[i].y = pos;
+            geoms[i].w = sizes[i];
+            geoms[i].h = size;
+            x += sizes[i];
+        }
+    } else {
+        int y = zone->y;
+
+        for (int i = 0; i < count; i++) {
+            geoms[i].x = pos;
+            geoms[i].y = y;
+            geoms[i].w = size;
+            geoms[i].h = sizes[i];
+            y += sizes[i];
+        }
+    }
+}
 
-            y = _G.tinfo->pos[stack];
-            cw = 0;
-            w = zw / count;
-            h = _G.tinfo->size[stack];
+/* Computes the geometry of each border of @list if they were laid out
+ * in a stack at @pos of @size. @lonely is set for the only window of
+ * the desk, which then takes the whole zone. */
+static void
+_stack_layout(const Eina_List *list, int pos, int size, bool lonely,
+              geom_t *geoms)
+{
+    int count = eina_list_count(list), i = 0;
+    span_t spans[MAX(count, 1)];
+    geom_t zone;
 
-            for (Eina_List *l = _G.tinfo->stacks[stack]; l; l = l->next, i++) {
-                E_Border *bd = l->data;
-                Border_Extra *extra;
-                int d = (i * 2 * zw) % count
-                    - (2 * cw) % count;
+    e_zone_useful_geometry_get(_G.tinfo->desk->zone,
+                               &zone.x, &zone.y, &zone.w, &zone.h);
 
-                extra = eina_hash_find(_G.border_extras, &bd);
-                if (!extra) {
-                    ERR("No extra for %p", bd);
-                    continue;
-                }
+    for (const Eina_List *l = list; l; l = l->next, i++) {
+        E_Border *bd = l->data;
+        Border_Extra *extra;
 
-                if ((bd->maximized & E_MAXIMIZE_HORIZONTAL) && count != 1) {
-                    _e_border_unmaximize(bd, E_MAXIMIZE_HORIZONTAL);
-                }
-                /* let's use a bresenham here */
+        extra = eina_hash_find(_G.border_extras, &bd);
+        spans[i].weight = extra ? extra->weight : 0;
+        _border_span(bd, _G.tinfo->conf->use_rows, &spans[i]);
+    }
 
-                extra->expected.x = cw + zx;
-                extra->expected.y = y;
-                extra->expected.w = w + d;
-                extra->expected.h = h;
-                cw += extra->expected.w;
+    _spans_layout(&zone, _G.tinfo->conf->use_rows, count, spans,
+                  pos, size, lonely, geoms);
+}
 
-                _e_border_move_resize(bd,
-                                      extra->expected.x,
-                                      extra->expected.y,
-                                      extra->expected.w,
-                                      extra->expected.h);
-            }
-        } else {
-            int x, w, h, ch;
+static void
+_reorganize_stack(int stack)
+{
+    int count, i = 0;
+    bool lonely;
 
-            x = _G.tinfo->pos[stack];
-            ch = 0;
-            w = _G.tinfo->size[stack];
-            h = zh / count;
+    if (stack < 0 || stack >= TILING_MAX_STACKS
+        || !_G.tinfo->stacks[stack])
+        return;
 
-            for (Eina_List *l = _G.tinfo->stacks[stack]; l; l = l->next, i++) {
-                E_Border *bd = l->data;
-                Border_Extra *extra;
-                int d = (i * 2 * zh) % count
-                    - (2 * ch) % count;
+    count = eina_list_count(_G.tinfo->stacks[stack]);
+    lonely = (stack == 0 && count == 1 && !_G.tinfo->stacks[1]);
 
-                extra = eina_hash_find(_G.border_extras, &bd);
-                if (!extra) {
-                    ERR("No extra for %p", bd);
-                    continue;
-                }
+    {
+        geom_t geoms[count];
 
-                if ((bd->maximized & E_MAXIMIZE_VERTICAL) && count != 1) {
-                    _e_border_unmaximize(bd, E_MAXIMIZE_VERTICAL);
-                }
-                /* let's use a bresenham here */
+        _stack_layout(_G.tinfo->stacks[stack],
+                      _G.tinfo->pos[stack], _G.tinfo->size[stack],
+                      lonely, geoms);
 
-                extra->expected.x = x;
-                extra->expected.y = ch + zy;
-                extra->expected.w = w;
-                extra->expected.h = h + d;
-                ch += extra->expected.h;
+        for (Eina_List *l = _G.tinfo->stacks[stack]; l; l = l->next, i++) {
+            E_Border *bd = l->data;
+            Border_Extra *extra;
 
-                _e_border_move_resize(bd,
-                                      extra->expected.x,
-                                      extra->expected.y,
-                                      extra->expected.w,
-                                      extra->expected.h);
+            extra = eina_hash_find(_G.border_extras, &bd);
+            if (!extra) {
+                ERR("No extra for %p", bd);
+                continue;
             }
+
+            extra->expected = geoms[i];
+            extra->maximize = _desired_maximize(stack, count);
+            _update_weight(extra);
+            _commit_border(bd, extra);
         }
-    } else {
+    }
+}
+
+static void
+_move_resize_stack(int stack, int delta_pos, int delta_size)
+{
+    Eina_List *list = _G.tinfo->stacks[stack];
+
+    for (Eina_List *l = list; l; l = l->next) {
+        E_Border *bd = l->data;
         Border_Extra *extra;
-        E_Border *bd = _G.tinfo->stacks[stack]->data;
 
         extra = eina_hash_find(_G.border_extras, &bd);
         if (!extra) {
             ERR("No extra for %p", bd);
-            return;
+            continue;
         }
 
         if (_G.tinfo->conf->use_rows) {
-            int x, w;
-
-            e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                       &x, NULL, &w, NULL);
-
-            extra->expected.x = x;
-            extra->expected.y = _G.tinfo->pos[stack];
-            extra->expected.w = w;
-            extra->expected.h = _G.tinfo->size[stack];
-
-            _e_border_move_resize(bd,
-                                  extra->expected.x,
-                                  extra->expected.y,
-                                  extra->expected.w,
-                                  extra->expected.h);
-
-            _e_border_maximize(bd, E_MAXIMIZE_EXPAND | E_MAXIMIZE_HORIZONTAL);
+            extra->expected.y += delta_pos;
+            extra->expected.h += delta_size;
         } else {
-            int y, h;
-
-            e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                       NULL, &y, NULL, &h);
-
-            extra->expected.x = _G.tinfo->pos[stack];
-            extra->expected.y = y;
-            extra->expected.w = _G.tinfo->size[stack];
-            extra->expected.h = h;
-
-            _e_border_move_resize(bd,
-                                  extra->expected.x,
-                                  extra->expected.y,
-                                  extra->expected.w,
-                                  extra->expected.h);
-
-            _e_border_maximize(bd, E_MAXIMIZE_EXPAND | E_MAXIMIZE_VERTICAL);
+            extra->expected.x += delta_pos;
+            extra->expected.w += delta_size;
         }
+
+        _e_border_move_resize(bd,
+                              extra->expected.x,
+                              extra->expected.y,
+                              extra->expected.w,
+                              extra->expected.h);
     }
+
+    _G.tinfo->pos[stack] += delta_pos;
+    _G.tinfo->size[stack] += delta_size;
 }
 
 static void
-_move_resize_stack(int stack, int delta_pos, int delta_size)
+_set_stack_geometry(int stack, int pos, int size)
 {
-    Eina_List *list = _G.tinfo->stacks[stack];
+    int count = eina_list_count(_G.tinfo->stacks[stack]);
 
-    for (Eina_List *l = list; l; l = l->next) {
+    for (Eina_List *l = _G.tinfo->stacks[stack]; l; l = l->next) {
         E_Border *bd = l->data;
         Border_Extra *extra;
 
@@ -839,75 +3127,262 @@ _move_resize_stack(int stack, int delta_pos, int delta_size)
             ERR("No extra for %p", bd);
             continue;
         }
+        DBG("expected: %dx%d+%d+%d (%p)",
+            extra->expected.w,
+            extra->expected.h,
+            extra->expected.x,
+            extra->expected.y,
+            bd);
 
         if (_G.tinfo->conf->use_rows) {
-            extra->expected.y += delta_pos;
-            extra->expected.h += delta_size;
+            extra->expected.y = pos;
+            extra->expected.h = size;
         } else {
-            extra->expected.x += delta_pos;
-            extra->expected.w += delta_size;
+            extra->expected.x = pos;
+            extra->expected.w = size;
+        }
+        extra->maximize = _desired_maximize(stack, count);
+
+        _commit_border(bd, extra);
+    }
+    _G.tinfo->pos[stack] = pos;
+    _G.tinfo->size[stack] = size;
+}
+
+/* Splits @total pixels from @pos between @nb_stacks stacks of @spans,
+ * in proportion to their weight when positive and of the average weight
+ * otherwise. Uses no global state, as _spans_layout(). */
+static void
+_split_stack_spans(int pos, int total, int nb_stacks, span_t *spans,
+                   int *positions, int *sizes)
+{
+    double known = 0.0;
+    int nb_known = 0;
+
+    for (int i = 0; i < nb_stacks; i++) {
+        if (spans[i].weight > 0) {
+            known += spans[i].weight;
+            nb_known++;
         }
+    }
+    for (int i = 0; i < nb_stacks; i++) {
+        if (spans[i].weight <= 0)
+            spans[i].weight = nb_known ? known / nb_known : 1.0;
+    }
+    _split_spans(total, nb_stacks, spans, sizes);
+
+    for (int i = 0; i < nb_stacks; i++) {
+        positions[i] = pos;
+        pos += sizes[i];
+    }
+}
+
+/* Only sets the position and size of the @nb_stacks first stacks, so
+ * that borders can then be placed in one go by _reorganize_stack().
+ * Stacks share the room in proportion to @hints, when set and positive,
+ * and get the average share otherwise */
+static void
+_split_stacks_hinted(int nb_stacks, const int *hints)
+{
+    span_t spans[TILING_MAX_STACKS];
+    int pos, s;
+
+    if (nb_stacks <= 0)
+        return;
+
+    if (_G.tinfo->conf->use_rows)
+        e_zone_useful_geometry_get(_G.tinfo->desk->zone,
+                                   NULL, &pos, NULL, &s);
+    else
+        e_zone_useful_geometry_get(_G.tinfo->desk->zone,
+                                   &pos, NULL, &s, NULL);
+
+    for (int i = 0; i < nb_stacks; i++) {
+        spans[i].weight = hints ? hints[i] : 0;
+        _stack_span(_G.tinfo->stacks[i], !_G.tinfo->conf->use_rows,
+                    &spans[i]);
+    }
+    _split_stack_spans(pos, s, nb_stacks, spans,
+                       _G.tinfo->pos, _G.tinfo->size);
+}
+
+static void
+_split_stacks(int nb_stacks)
+{
+    _split_stacks_hinted(nb_stacks, NULL);
+}
+
+static void
+_geom_cost(const geom_t *from, const geom_t *to, layout_cost_t *cost)
+{
+    int iw, ih;
+
+    if (from->x == to->x && from->y == to->y
+    &&  from->w == to->w && from->h == to->h)
+        return;
+
+    if (from->w != to->w || from->h != to->h)
+        cost->resized++;
+
+    /* area of the symmetric difference of both rectangles */
+    iw = MIN(from->x + from->w, to->x + to->w) - MAX(from->x, to->x);
+    ih = MIN(from->y + from->h, to->y + to->h) - MAX(from->y, to->y);
+    cost->area += (long long)from->w * from->h + (long long)to->w * to->h;
+    if (iw > 0 && ih > 0)
+        cost->area -= 2LL * iw * ih;
+}
+
+/* Adds to @cost what laying out @lists[i] in stack i would change, for
+ * every stack up to @nb_stacks */
+static void
+_layout_cost(Eina_List **lists, int nb_stacks, layout_cost_t *cost)
+{
+    for (int i = 0; i < nb_stacks; i++) {
+        int count = eina_list_count(lists[i]), n = 0;
+        geom_t geoms[MAX(count, 1)];
+
+        if (!count)
+            continue;
 
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
+        _stack_layout(lists[i], _G.tinfo->pos[i], _G.tinfo->size[i],
+                      false, geoms);
+        for (Eina_List *l = lists[i]; l; l = l->next, n++) {
+            E_Border *bd = l->data;
+            Border_Extra *extra;
+
+            extra = eina_hash_find(_G.border_extras, &bd);
+            if (extra)
+                _geom_cost(&extra->expected, &geoms[n], cost);
+        }
     }
+}
 
-    _G.tinfo->pos[stack] += delta_pos;
-    _G.tinfo->size[stack] += delta_size;
+static bool
+_layout_cost_lower(const layout_cost_t *a, const layout_cost_t *b)
+{
+    if (a->resized != b->resized)
+        return a->resized < b->resized;
+    return a->area < b->area;
 }
 
+/* What shifting whole stacks towards @target until one of them can
+ * spare a window, as tiling used to do, would have changed */
 static void
-_set_stack_geometry(int stack, int pos, int size)
+_cascade_cost(int target, int nb_stacks, layout_cost_t *cost)
 {
-    for (Eina_List *l = _G.tinfo->stacks[stack]; l; l = l->next) {
-        E_Border *bd = l->data;
-        Border_Extra *extra;
+    Eina_List *lists[TILING_MAX_STACKS] = {NULL};
+    Eina_List *donor = NULL;
+    int from = -1;
+
+    memcpy(lists, _G.tinfo->stacks, sizeof(lists));
+
+    for (int i = target + 1; i < nb_stacks; i++) {
+        if (eina_list_count(_G.tinfo->stacks[i]) > 1) {
+            for (int j = target; j < i - 1; j++)
+                lists[j] = _G.tinfo->stacks[j + 1];
+            donor = eina_list_clone(_G.tinfo->stacks[i]);
+            lists[i - 1] = eina_list_append(NULL, donor->data);
+            donor = eina_list_remove_list(donor, donor);
+            lists[i] = donor;
+            from = i - 1;
+            break;
+        }
+    }
+    for (int i = target - 1; from < 0 && i >= 0; i--) {
+        if (eina_list_count(_G.tinfo->stacks[i]) > 1) {
+            for (int j = target; j > i + 1; j--)
+                lists[j] = _G.tinfo->stacks[j - 1];
+            donor = eina_list_clone(_G.tinfo->stacks[i]);
+            lists[i + 1] = eina_list_append(NULL,
+                                            eina_list_last(donor)->data);
+            donor = eina_list_remove_list(donor, eina_list_last(donor));
+            lists[i] = donor;
+            from = i + 1;
+        }
+    }
+    if (from < 0)
+        return;
 
-        extra = eina_hash_find(_G.border_extras, &bd);
-        if (!extra) {
-            ERR("No extra for %p", bd);
+    _layout_cost(lists, nb_stacks, cost);
+
+    eina_list_free(lists[from]);
+    eina_list_free(donor);
+}
+
+/* Fills the empty stack @target with a border taken from another stack.
+ * The first or last border of every stack holding more than one is
+ * considered, and the one resizing the fewest windows, then changing
+ * the smallest area, then coming from the nearest stack wins.
+ * Stack positions and sizes must already be set.
+ * Returns the stack the border was taken from. */
+static int
+_rebalance_into(int target, int nb_stacks)
+{
+    layout_cost_t best = { .resized = INT_MAX, .area = LLONG_MAX },
+                  cascade = { 0, 0 };
+    E_Border *best_bd = NULL;
+    int best_stack = -1;
+
+    for (int i = 0; i < nb_stacks; i++) {
+        Eina_List *candidates[2];
+
+        if (i == target || !_G.tinfo->stacks[i]
+        ||  !_G.tinfo->stacks[i]->next)
             continue;
-        }
-        DBG("expected: %dx%d+%d+%d (%p)",
-            extra->expected.w,
-            extra->expected.h,
-            extra->expected.x,
-            extra->expected.y,
-            bd);
 
-        if (_G.tinfo->conf->use_rows) {
-            extra->expected.y = pos;
-            extra->expected.h = size;
+        candidates[0] = _G.tinfo->stacks[i];
+        candidates[1] = eina_list_last(_G.tinfo->stacks[i]);
 
-            if (bd->maximized) {
-                if (l->next && (bd->maximized & E_MAXIMIZE_HORIZONTAL))
-                    _e_border_unmaximize(bd, E_MAXIMIZE_HORIZONTAL);
-                if (_G.tinfo->stacks[1] && (bd->maximized & E_MAXIMIZE_VERTICAL))
-                    _e_border_unmaximize(bd, E_MAXIMIZE_VERTICAL);
-            }
-        } else {
-            extra->expected.x = pos;
-            extra->expected.w = size;
+        for (int c = 0; c < 2; c++) {
+            Eina_List *lists[TILING_MAX_STACKS];
+            layout_cost_t cost = { 0, 0 };
+            E_Border *bd = candidates[c]->data;
+
+            memcpy(lists, _G.tinfo->stacks, sizeof(lists));
+            lists[i] = eina_list_remove(eina_list_clone(lists[i]), bd);
+            lists[target] = eina_list_append(NULL, bd);
 
-            if (bd->maximized) {
-                if (l->next && (bd->maximized & E_MAXIMIZE_VERTICAL))
-                    _e_border_unmaximize(bd, E_MAXIMIZE_VERTICAL);
-                if (_G.tinfo->stacks[1] && (bd->maximized & E_MAXIMIZE_HORIZONTAL))
-                    _e_border_unmaximize(bd, E_MAXIMIZE_HORIZONTAL);
+            _layout_cost(lists, nb_stacks, &cost);
+
+            eina_list_free(lists[i]);
+            eina_list_free(lists[target]);
+
+            if (_layout_cost_lower(&cost, &best)
+            ||  (!_layout_cost_lower(&best, &cost)
+                 && abs(i - target) < abs(best_stack - target))) {
+                best = cost;
+                best_bd = bd;
+                best_stack = i;
             }
         }
+    }
 
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
+    if (!best_bd) {
+        ERR("no border to move into stack %d", target);
+        return -1;
     }
-    _G.tinfo->pos[stack] = pos;
-    _G.tinfo->size[stack] = size;
+
+    _cascade_cost(target, nb_stacks, &cascade);
+
+    _G.stats.rebalances++;
+    _G.stats.resized += best.resized;
+    _G.stats.area += best.area;
+    _G.stats.cascade_resized += cascade.resized;
+    _G.stats.cascade_area += cascade.area;
+    DBG("rebalance: %p from stack %d into %d: %d resized (%lld px),"
+        " cascade: %d resized (%lld px); total %u: %u/%u resized,"
+        " %lld/%lld px",
+        best_bd, best_stack, target,
+        best.resized, best.area, cascade.resized, cascade.area,
+        _G.stats.rebalances, _G.stats.resized, _G.stats.cascade_resized,
+        _G.stats.area, _G.stats.cascade_area);
+
+    EINA_LIST_REMOVE(_G.tinfo->stacks[best_stack], best_bd);
+    EINA_LIST_APPEND(_G.tinfo->stacks[target], best_bd);
+    _reorganize_stack(best_stack);
+    _reorganize_stack(target);
+
+    return best_stack;
 }
 
 static void
@@ -921,54 +3396,35 @@ _add_stack(void)
     _G.tinfo->conf->nb_stacks++;
 
     if (_G.tinfo->conf->nb_stacks == 1) {
-        for (Eina_List *l = e_border_focus_stack_get(); l; l = l->next) {
+        Eina_List *borders = NULL;
+
+        for (Eina_List *l = _G.tinfo->windows; l; l = l->next) {
             E_Border *bd;
 
             bd = l->data;
-            if (bd->desk == _G.tinfo->desk)
-                _add_border(bd);
+            if (!EINA_LIST_IS_IN(_G.tinfo->iconified_windows, bd))
+                EINA_LIST_APPEND(borders, bd);
         }
+        _add_borders(borders, true);
+        eina_list_free(borders);
     }
     nb_borders = get_window_count();
-    if (_G.tinfo->stacks[_G.tinfo->conf->nb_stacks - 2]
+    if (_G.tinfo->conf->nb_stacks > 1
+    &&  _G.tinfo->stacks[_G.tinfo->conf->nb_stacks - 2]
     &&  nb_borders >= _G.tinfo->conf->nb_stacks)
     {
-        int nb_stacks = _G.tinfo->conf->nb_stacks - 1;
-        int pos, s;
-        /* Add stack */
-
-        if (_G.tinfo->conf->use_rows)
-            e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                       NULL, &pos, NULL, &s);
-        else
-            e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                       &pos, NULL, &s, NULL);
-
-        for (int i = 0; i <= nb_stacks; i++) {
-            int size = 0;
-
-            size = s / (nb_stacks + 1 - i);
+        int nb_stacks = _G.tinfo->conf->nb_stacks;
+        int donor;
 
-            _set_stack_geometry(i, pos, size);
+        /* Add stack */
+        _split_stacks(nb_stacks);
 
-            s -= size;
-            pos += size;
-        }
-        for (int i = nb_stacks - 1; i >= 0; i--) {
-            if (eina_list_count(_G.tinfo->stacks[i]) == 1) {
-                _G.tinfo->stacks[i+1] = _G.tinfo->stacks[i];
-                _reorganize_stack(i+1);
-            } else {
-                E_Border *bd = eina_list_last(_G.tinfo->stacks[i])->data;
+        donor = _rebalance_into(nb_stacks - 1, nb_stacks);
 
-                EINA_LIST_REMOVE(_G.tinfo->stacks[i], bd);
+        /* The stacks which did not give a window still moved */
+        for (int i = 0; i < nb_stacks - 1; i++) {
+            if (i != donor)
                 _reorganize_stack(i);
-
-                _G.tinfo->stacks[i+1] = NULL;
-                EINA_LIST_APPEND(_G.tinfo->stacks[i+1], bd);
-                _reorganize_stack(i+1);
-                return;
-            }
         }
     }
 }
@@ -995,7 +3451,6 @@ _remove_stack(void)
     } else {
         int nb_stacks = _G.tinfo->conf->nb_stacks;
         int stack = _G.tinfo->conf->nb_stacks;
-        int pos, s;
 
         if (_G.tinfo->stacks[stack]) {
             _G.tinfo->stacks[stack-1] = eina_list_merge(
@@ -1003,23 +3458,9 @@ _remove_stack(void)
             _reorganize_stack(stack-1);
         }
 
-        if (_G.tinfo->conf->use_rows) {
-            e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                       NULL, &pos, NULL, &s);
-        } else {
-            e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                       &pos, NULL, &s, NULL);
-        }
-        for (int i = 0; i < nb_stacks; i++) {
-            int size = 0;
-
-            size = s / (nb_stacks - i);
-
-            _set_stack_geometry(i, pos, size);
-
-            s -= size;
-            pos += size;
-        }
+        _split_stacks(nb_stacks);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
     }
 }
 
@@ -1049,66 +3490,42 @@ _toggle_rows_cols(void)
     }
 #else
     int nb_stacks = _G.tinfo->conf->nb_stacks;
-    int pos, s;
 
     _G.tinfo->conf->use_rows = !_G.tinfo->conf->use_rows;
 
-    if (_G.tinfo->conf->use_rows)
-        e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                   NULL, &pos, NULL, &s);
-    else
-        e_zone_useful_geometry_get(_G.tinfo->desk->zone,
-                                   &pos, NULL, &s, NULL);
-
+    /* Weights were measured along the other axis */
     for (int i = 0; i < nb_stacks; i++) {
-        int size = 0;
-
-        size = s / (nb_stacks - i);
-
-        _set_stack_geometry(i, pos, size);
-
-        s -= size;
-        pos += size;
+        for (Eina_List *l = _G.tinfo->stacks[i]; l; l = l->next)
+            _forget_weight(l->data);
     }
+
+    _split_stacks(nb_stacks);
+    for (int i = 0; i < nb_stacks; i++)
+        _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
     for (int i = 0; i < nb_stacks; i++) {
         _reorganize_stack(i);
     }
 #endif
 }
 
-void
-change_desk_conf(struct _Config_vdesk *newconf)
+/* Brings the stacks of the desk of _G.tinfo from what they were when
+ * change_desk_conf() was first called to its configuration now */
+static void
+_desk_conf_apply(void)
 {
-    E_Manager *m;
-    E_Container *c;
-    E_Zone *z;
-    E_Desk *d;
-    int old_nb_stacks = 0,
-        new_nb_stacks = newconf->nb_stacks;
+    struct _Config_vdesk *conf = _G.tinfo->conf;
+    int old_nb_stacks = _G.tinfo->applied_nb_stacks,
+        new_nb_stacks = conf ? conf->nb_stacks : 0;
 
-    m = e_manager_current_get();
-    if (!m) return;
-    c = e_container_current_get(m);
-    if (!c) return;
-    z = e_container_zone_number_get(c, newconf->zone_num);
-    if (!z) return;
-    d = e_desk_at_xy_get(z, newconf->x, newconf->y);
-    if (!d) return;
+    _G.tinfo->conf_pending = false;
 
-    check_tinfo(d);
-    if (_G.tinfo->conf) {
-        old_nb_stacks = _G.tinfo->conf->nb_stacks;
-        if (_G.tinfo->conf->use_rows != newconf->use_rows) {
-            _G.tinfo->conf = newconf;
-            _G.tinfo->conf->use_rows = !_G.tinfo->conf->use_rows;
-            _toggle_rows_cols();
-            return;
-        }
-    } else {
-        newconf->nb_stacks = 0;
+    if (conf && old_nb_stacks
+    &&  conf->use_rows != _G.tinfo->applied_use_rows) {
+        conf->use_rows = _G.tinfo->applied_use_rows;
+        conf->nb_stacks = old_nb_stacks;
+        _toggle_rows_cols();
+        conf->nb_stacks = new_nb_stacks;
     }
-    _G.tinfo->conf = newconf;
-    _G.tinfo->conf->nb_stacks = old_nb_stacks;
 
     if (new_nb_stacks == old_nb_stacks)
         return;
@@ -1123,8 +3540,12 @@ change_desk_conf(struct _Config_vdesk *newconf)
             eina_list_free(_G.tinfo->stacks[i]);
             _G.tinfo->stacks[i] = NULL;
         }
-        e_place_zone_region_smart_cleanup(z);
-    } else if (new_nb_stacks > old_nb_stacks) {
+        e_place_zone_region_smart_cleanup(_G.tinfo->desk->zone);
+        return;
+    }
+
+    conf->nb_stacks = old_nb_stacks;
+    if (new_nb_stacks > old_nb_stacks) {
         for (int i = new_nb_stacks; i > old_nb_stacks; i--) {
             _add_stack();
         }
@@ -1133,7 +3554,41 @@ change_desk_conf(struct _Config_vdesk *newconf)
             _remove_stack();
         }
     }
-    _G.tinfo->conf->nb_stacks = new_nb_stacks;
+    conf->nb_stacks = new_nb_stacks;
+}
+
+/* Called by the configuration dialog for every desk whose configuration
+ * changes, before e_tiling_update_conf(). The desk is only laid out from
+ * the relayout queue. */
+void
+change_desk_conf(struct _Config_vdesk *newconf)
+{
+    E_Manager *m;
+    E_Container *c;
+    E_Zone *z;
+    E_Desk *d;
+
+    m = e_manager_current_get();
+    if (!m) return;
+    c = e_container_current_get(m);
+    if (!c) return;
+    z = e_container_zone_number_get(c, newconf->zone_num);
+    if (!z) return;
+    d = e_desk_at_xy_get(z, newconf->x, newconf->y);
+    if (!d) return;
+
+    check_tinfo(d);
+    if (!_G.tinfo->conf_pending) {
+        _G.tinfo->conf_pending = true;
+        if (_G.tinfo->conf) {
+            _G.tinfo->applied_nb_stacks = _G.tinfo->conf->nb_stacks;
+            _G.tinfo->applied_use_rows = _G.tinfo->conf->use_rows;
+        } else {
+            _G.tinfo->applied_nb_stacks = 0;
+            _G.tinfo->applied_use_rows = newconf->use_rows;
+        }
+    }
+    _queue_relayout(d);
 }
 
 static void
@@ -1209,116 +3664,309 @@ _add_border(E_Border *bd)
     }
 
     extra = _get_or_create_border_extra(bd);
+    extra->weight = 0;
+    _watchdog_reset(extra);
+    _layout_forget(bd);
 
     /* Stack tiled window below so that winlist doesn't mix up stacking */
-    e_border_layer_set(bd, 75);
+    e_border_layer_set(bd, TILING_BORDER_LAYER);
     e_hints_window_stacking_set(bd, E_STACKING_BELOW);
 
     DBG("adding %p", bd);
 
     if (_G.tinfo->stacks[0]) {
+        const struct _Config_placement *pl = NULL;
+        int position = -1;
+
         DBG("got stack 0");
-        if (_G.tinfo->stacks[_G.tinfo->conf->nb_stacks - 1]) {
+        stack = _rule_stack(bd);
+        if (stack < 0 && (pl = _placement_find(bd))
+        &&  pl->stack < get_stack_count()) {
+            DBG("remembered in stack %d", pl->stack);
+            stack = pl->stack;
+            position = pl->position;
+            extra->weight = pl->weight;
+        }
+        if (stack < 0 && _G.tinfo->stacks[_G.tinfo->conf->nb_stacks - 1]) {
             DBG("using last stack");
             stack = _G.tinfo->conf->nb_stacks - 1;
-
-            if (!_G.tinfo->stacks[stack]->next) {
-                _e_border_unmaximize(_G.tinfo->stacks[stack]->data,
-                                    E_MAXIMIZE_BOTH);
-            }
-            EINA_LIST_APPEND(_G.tinfo->stacks[stack], bd);
+        }
+        if (stack >= 0) {
+            _stack_insert(stack, bd, position);
             _reorganize_stack(stack);
-            if (bd->maximized)
-                _e_border_unmaximize(bd, E_MAXIMIZE_BOTH);
         } else {
             /* Add stack */
             int nb_stacks = get_stack_count();
             int x, y, w, h;
-            int pos, s, size = 0;
+            int pos, size;
 
             DBG("add stack");
 
             e_zone_useful_geometry_get(bd->zone, &x, &y, &w, &h);
 
-            if (_G.tinfo->conf->use_rows) {
-                pos = y;
-                s = h;
-            } else {
-                pos = x;
-                s = w;
-            }
-
             EINA_LIST_APPEND(_G.tinfo->stacks[nb_stacks], bd);
 
-            for (int i = 0; i < nb_stacks; i++) {
-
-                size = s / (nb_stacks + 1 - i);
-
-                _set_stack_geometry(i, pos, size);
+            _split_stacks(nb_stacks + 1);
+            for (int i = 0; i < nb_stacks; i++)
+                _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
+            pos = _G.tinfo->pos[nb_stacks];
+            size = _G.tinfo->size[nb_stacks];
 
-                s -= size;
-                pos += size;
-            }
-
-            _G.tinfo->pos[nb_stacks] = pos;
-            _G.tinfo->size[nb_stacks] = size;
             if (_G.tinfo->conf->use_rows) {
                 extra->expected.x = x;
                 extra->expected.y = pos;
                 extra->expected.w = w;
                 extra->expected.h = size;
-                _e_border_maximize(bd, E_MAXIMIZE_EXPAND |
-                                      E_MAXIMIZE_HORIZONTAL);
             } else {
                 extra->expected.x = pos;
                 extra->expected.y = y;
                 extra->expected.w = size;
                 extra->expected.h = h;
-                _e_border_maximize(bd, E_MAXIMIZE_EXPAND |
-                                      E_MAXIMIZE_VERTICAL);
             }
-            _e_border_move_resize(bd,
-                                  extra->expected.x,
-                                  extra->expected.y,
-                                  extra->expected.w,
-                                  extra->expected.h);
+            extra->maximize = _desired_maximize(nb_stacks, 1);
+            _commit_border(bd, extra);
+
+            stack = nb_stacks;
+        }
+    } else {
+        DBG("lonely window");
+        e_zone_useful_geometry_get(bd->zone,
+                                   &extra->expected.x,
+                                   &extra->expected.y,
+                                   &extra->expected.w,
+                                   &extra->expected.h);
+
+        extra->maximize = E_MAXIMIZE_BOTH;
+        _commit_border(bd, extra);
+        EINA_LIST_APPEND(_G.tinfo->stacks[0], bd);
+        if (_G.tinfo->conf->use_rows) {
+            e_zone_useful_geometry_get(bd->zone,
+                                       NULL, &_G.tinfo->pos[0],
+                                       NULL, &_G.tinfo->size[0]);
+        } else {
+            e_zone_useful_geometry_get(bd->zone,
+                                       &_G.tinfo->pos[0], NULL,
+                                       &_G.tinfo->size[0], NULL);
+        }
+        stack = 0;
+    }
+    _update_weight(extra);
+    DBG("expected: %dx%d+%d+%d (%p)",
+        extra->expected.w,
+        extra->expected.h,
+        extra->expected.x,
+        extra->expected.y,
+        bd);
+}
+
+/* Tile a burst of new borders at once: every border is first put in
+ * its stack, then each stack is laid out a single time. Float rules are
+ * applied if @apply_rules, when the borders were not tiled before. */
+static void
+_add_borders(Eina_List *borders, bool apply_rules)
+{
+    bool touched[TILING_MAX_STACKS] = {false};
+    int hints[TILING_MAX_STACKS] = {0};
+    int old_nb_stacks, nb_stacks;
+    Eina_List *sorted, *l;
+    E_Border *bd;
+    Border_Extra *extra;
+    bool restored = false;
+    int n = 0;
+
+    if (!_G.tinfo || !_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
+        return;
+    }
+
+    old_nb_stacks = nb_stacks = get_stack_count();
+
+    /* Windows from the saved layout first, in their saved order */
+    sorted = eina_list_sort(eina_list_clone(borders), 0, _layout_cmp);
+
+    EINA_LIST_FOREACH(sorted, l, bd) {
+        const struct _Config_layout_window *lw;
+        const struct _Config_placement *pl;
+        int stack, position;
+
+        if (is_floating_window(bd) || !is_tilable(bd) || bd->fullscreen)
+            continue;
+        if (get_stack(bd) >= 0)
+            continue;
+        if (apply_rules && _rule_float(bd))
+            continue;
+
+        extra = _get_or_create_border_extra(bd);
+        extra->weight = 0;
+        _watchdog_reset(extra);
+
+        /* Stack tiled window below so that winlist doesn't mix up stacking */
+        e_border_layer_set(bd, TILING_BORDER_LAYER);
+        e_hints_window_stacking_set(bd, E_STACKING_BELOW);
+
+        position = -1;
+        stack = -1;
+        if ((lw = _layout_find(bd))) {
+            if (lw->stack < nb_stacks)
+                stack = lw->stack;
+            else if (nb_stacks < _G.tinfo->conf->nb_stacks)
+                stack = nb_stacks++;
+            else
+                stack = nb_stacks - 1;
+            position = lw->position;
+            extra->weight = lw->weight;
+            hints[stack] = lw->stack_size;
+            restored = true;
+            _layout_forget(bd);
+        }
+        if (stack < 0)
+            stack = _rule_stack(bd);
+        if (stack < 0 && (pl = _placement_find(bd))
+        &&  pl->stack < get_stack_count()) {
+            stack = pl->stack;
+            position = pl->position;
+            extra->weight = pl->weight;
+        }
+        if (stack >= 0)
+            ;
+        else if (nb_stacks < _G.tinfo->conf->nb_stacks)
+            stack = nb_stacks++;
+        else
+            stack = nb_stacks - 1;
+
+        _stack_insert(stack, bd, position);
+        touched[stack] = true;
+        n++;
+    }
+    eina_list_free(sorted);
+
+    DBG("adding %d borders at once (%d -> %d stacks)",
+        n, old_nb_stacks, nb_stacks);
+
+    if (!n)
+        return;
+
+    if (nb_stacks != old_nb_stacks || restored) {
+        /* Stacks not coming from the saved layout keep their size */
+        for (int i = 0; i < old_nb_stacks; i++) {
+            if (!hints[i])
+                hints[i] = _G.tinfo->size[i];
+        }
+        _split_stacks_hinted(nb_stacks, restored ? hints : NULL);
+    }
+
+    for (int i = 0; i < nb_stacks; i++) {
+        if (touched[i] || nb_stacks != old_nb_stacks || restored)
+            _reorganize_stack(i);
+    }
+}
+
+static Eina_Bool
+_pending_timer_cb(void *data)
+{
+    Tiling_Info *tinfo = data;
+    Eina_List *borders = tinfo->pending_windows;
+
+    tinfo->pending_windows = NULL;
+    tinfo->pending_timer = NULL;
+
+    check_tinfo(tinfo->desk);
+    _add_borders(borders, true);
+    eina_list_free(borders);
+
+    return ECORE_CALLBACK_CANCEL;
+}
+
+static Eina_Bool
+_tile_desk_borders(const Eina_Hash *hash, const void *key,
+                   void *data, void *fdata)
+{
+    const E_Desk *desk = *(const E_Desk **)key;
+    Eina_List *borders = data;
+    bool visible = *(bool *)fdata;
+
+    if (desk->visible != visible)
+        return EINA_TRUE;
+
+    check_tinfo(desk);
+    if (_G.tinfo->conf && _G.tinfo->conf->nb_stacks)
+        _add_borders(borders, true);
+
+    return EINA_TRUE;
+}
+
+static void
+_desk_borders_free(void *data)
+{
+    eina_list_free(data);
+}
+
+/* Tiles every existing window, desk by desk: each desk is laid out a
+ * single time, the visible ones first */
+static void
+_tile_existing_borders(void)
+{
+    Eina_Hash *desks = eina_hash_pointer_new(_desk_borders_free);
+    Tiling_Info *tinfo = _G.tinfo;
+    bool visible;
+
+    for (Eina_List *l = e_border_client_list(); l; l = l->next) {
+        E_Border *bd = l->data;
+        Eina_List *borders;
+
+        _index_add(bd);
+        if (!bd->desk || bd->iconic)
+            continue;
+
+        borders = eina_hash_find(desks, &bd->desk);
+        borders = eina_list_append(borders, bd);
+        eina_hash_set(desks, &bd->desk, borders);
+    }
+
+    visible = true;
+    eina_hash_foreach(desks, _tile_desk_borders, &visible);
+    visible = false;
+    eina_hash_foreach(desks, _tile_desk_borders, &visible);
 
-            stack = nb_stacks;
-        }
-    } else {
-        DBG("lonely window");
-        e_zone_useful_geometry_get(bd->zone,
-                                   &extra->expected.x,
-                                   &extra->expected.y,
-                                   &extra->expected.w,
-                                   &extra->expected.h);
+    eina_hash_free(desks);
+    _G.tinfo = tinfo;
+}
 
-        if (bd->maximized & E_MAXIMIZE_BOTH)
-            _e_border_unmaximize(bd, E_MAXIMIZE_BOTH);
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
-        _e_border_maximize(bd, E_MAXIMIZE_EXPAND | E_MAXIMIZE_BOTH);
-        EINA_LIST_APPEND(_G.tinfo->stacks[0], bd);
-        if (_G.tinfo->conf->use_rows) {
-            e_zone_useful_geometry_get(bd->zone,
-                                       NULL, &_G.tinfo->pos[0],
-                                       NULL, &_G.tinfo->size[0]);
-        } else {
-            e_zone_useful_geometry_get(bd->zone,
-                                       &_G.tinfo->pos[0], NULL,
-                                       &_G.tinfo->size[0], NULL);
-        }
-        stack = 0;
+/* Defer the placement of @bd for add_delay ms so that every window
+ * appearing meanwhile on the same desk is tiled by one relayout */
+static void
+_queue_border(E_Border *bd)
+{
+    /* Windows of the saved layout are always put back together */
+    if (tiling_g.config->add_delay <= 0 && !_layout_find(bd)) {
+        _add_border(bd);
+        return;
     }
-    DBG("expected: %dx%d+%d+%d (%p)",
-        extra->expected.w,
-        extra->expected.h,
-        extra->expected.x,
-        extra->expected.y,
-        bd);
+    if (EINA_LIST_IS_IN(_G.tinfo->pending_windows, bd))
+        return;
+
+    EINA_LIST_APPEND(_G.tinfo->pending_windows, bd);
+    if (!_G.tinfo->pending_timer) {
+        _G.tinfo->pending_timer =
+            ecore_timer_add(tiling_g.config->add_delay / 1000.0,
+                            _pending_timer_cb, _G.tinfo);
+    }
+}
+
+static bool
+_unqueue_border(const E_Desk *desk, E_Border *bd)
+{
+    Tiling_Info *tinfo;
+
+    tinfo = eina_hash_find(_G.info_hash, &desk);
+    if (!tinfo || !EINA_LIST_IS_IN(tinfo->pending_windows, bd))
+        return false;
+
+    EINA_LIST_REMOVE(tinfo->pending_windows, bd);
+    if (!tinfo->pending_windows && tinfo->pending_timer) {
+        ecore_timer_del(tinfo->pending_timer);
+        tinfo->pending_timer = NULL;
+    }
+    return true;
 }
 
 static void
@@ -1344,7 +3992,6 @@ _remove_border(E_Border *bd)
         int nb_borders = get_window_count();
 
         if (nb_stacks > nb_borders) {
-            int pos, s;
             /* Remove stack */
 
             nb_stacks--;
@@ -1353,60 +4000,17 @@ _remove_border(E_Border *bd)
                 _G.tinfo->stacks[i] = _G.tinfo->stacks[i+1];
             }
             _G.tinfo->stacks[nb_stacks] = NULL;
-            if (_G.tinfo->conf->use_rows) {
-                e_zone_useful_geometry_get(bd->zone,
-                                           NULL, &pos, NULL, &s);
-            } else {
-                e_zone_useful_geometry_get(bd->zone,
-                                           &pos, NULL, &s, NULL);
-            }
-            for (int i = 0; i < nb_stacks; i++) {
-                int size;
-
-                size = s / (nb_stacks - i);
-
-                _set_stack_geometry(i, pos, size);
-
-                s -= size;
-                pos += size;
-            }
+            _split_stacks(nb_stacks);
+            for (int i = 0; i < nb_stacks; i++)
+                _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
         } else {
-            for (int i = stack+1; i < nb_stacks; i++) {
-                if (eina_list_count(_G.tinfo->stacks[i]) > 1) {
-                    for (int j = stack; j < i - 1; j++) {
-                        _G.tinfo->stacks[j] = _G.tinfo->stacks[j+1];
-                        _reorganize_stack(j);
-                    }
-                    bd = _G.tinfo->stacks[i]->data;
-                    EINA_LIST_REMOVE(_G.tinfo->stacks[i], bd);
-                    _reorganize_stack(i);
-
-                    _G.tinfo->stacks[i-1] = NULL;
-                    EINA_LIST_APPEND(_G.tinfo->stacks[i-1], bd);
-                    _reorganize_stack(i-1);
-                    return;
-                }
-            }
-            for (int i = stack-1; i >= 0; i--) {
-                if (eina_list_count(_G.tinfo->stacks[i]) == 1) {
-                    _G.tinfo->stacks[i+1] = _G.tinfo->stacks[i];
-                    _reorganize_stack(i+1);
-                } else {
-                    bd = eina_list_last(_G.tinfo->stacks[i])->data;
-                    EINA_LIST_REMOVE(_G.tinfo->stacks[i], bd);
-                    _reorganize_stack(i);
-
-                    _G.tinfo->stacks[i+1] = NULL;
-                    EINA_LIST_APPEND(_G.tinfo->stacks[i+1], bd);
-                    _reorganize_stack(i+1);
-                    return;
-                }
-            }
+            _rebalance_into(stack, nb_stacks);
         }
     }
 }
 
-static void
+/* Returns false if the watchdog floated @bd, see _watchdog_check() */
+static bool
 _move_resize_border_stack(E_Border *bd, Border_Extra *extra,
                           int stack, tiling_change_t change)
 {
@@ -1414,30 +4018,30 @@ _move_resize_border_stack(E_Border *bd, Border_Extra *extra,
     if (change == TILING_RESIZE) {                                           \
         if (stack == TILING_MAX_STACKS || !_G.tinfo->stacks[stack + 1]) {    \
             /* You're not allowed to resize */                               \
+            if (_watchdog_check(bd, extra))                                  \
+                return false;                                                \
             bd->_size = extra->expected._size;                               \
         } else {                                                             \
             int delta = bd->_size - extra->expected._size;                   \
                                                                              \
-            if (delta + 1 > _G.tinfo->size[stack + 1])                       \
-                delta = _G.tinfo->size[stack + 1] - 1;                       \
+            delta = _clamp_stack_delta(stack, stack + 1, delta);             \
                                                                              \
             _move_resize_stack(stack, 0, delta);                             \
             _move_resize_stack(stack + 1, delta, -delta);                    \
-            extra->expected._size = bd->_size;                               \
         }                                                                    \
     } else {                                                                 \
         if (stack == 0) {                                                    \
             /* You're not allowed to move */                                 \
+            if (_watchdog_check(bd, extra))                                  \
+                return false;                                                \
             bd->_pos = extra->expected._pos;                                 \
         } else {                                                             \
             int delta = bd->_pos - extra->expected._pos;                     \
                                                                              \
-            if (delta + 1 > _G.tinfo->size[stack - 1])                       \
-                delta = _G.tinfo->size[stack - 1] - 1;                       \
+            delta = _clamp_stack_delta(stack - 1, stack, delta);             \
                                                                              \
             _move_resize_stack(stack, delta, -delta);                        \
             _move_resize_stack(stack - 1, 0, delta);                         \
-            extra->expected._pos = bd->_pos;                                 \
         }                                                                    \
     }
     if (_G.tinfo->conf->use_rows) {
@@ -1446,9 +4050,12 @@ _move_resize_border_stack(E_Border *bd, Border_Extra *extra,
         _MOVE_RESIZE_BORDER_STACK(x, w)
     }
 #undef _MOVE_RESIZE_BORDER_STACK
+
+    return true;
 }
 
-static void
+/* Returns false if the watchdog floated @bd, see _watchdog_check() */
+static bool
 _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
                               int stack, tiling_change_t change)
 {
@@ -1457,7 +4064,7 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
     l = eina_list_data_find_list(_G.tinfo->stacks[stack], bd);
     if (!l) {
         ERR("unable to bd %p in stack %d", bd, stack);
-        return;
+        return true;
     }
 
     switch (change) {
@@ -1470,33 +4077,43 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
                 prevextra = eina_hash_find(_G.border_extras, &prevbd);
                 if (!prevextra) {
                     ERR("No extra for %p", prevbd);
-                    return;
+                    return true;
                 }
 
                 if (_G.tinfo->conf->use_rows) {
                     int delta;
 
                     delta = bd->w - extra->expected.w;
+                    delta = _clamp_border_delta(bd, extra->expected.w,
+                                                prevbd, prevextra->expected.w,
+                                                delta);
                     prevextra->expected.w -= delta;
                     extra->expected.x -= delta;
-                    extra->expected.w = bd->w;
+                    extra->expected.w += delta;
                 } else {
                     int delta;
 
                     delta = bd->h - extra->expected.h;
+                    delta = _clamp_border_delta(bd, extra->expected.h,
+                                                prevbd, prevextra->expected.h,
+                                                delta);
                     prevextra->expected.h -= delta;
                     extra->expected.y -= delta;
-                    extra->expected.h = bd->h;
+                    extra->expected.h += delta;
                 }
 
                 _e_border_resize(prevbd,
                                  prevextra->expected.w,
                                  prevextra->expected.h);
-                _e_border_move(bd,
-                               extra->expected.x,
-                               extra->expected.y);
+                _e_border_move_resize(bd,
+                                      extra->expected.x,
+                                      extra->expected.y,
+                                      extra->expected.w,
+                                      extra->expected.h);
             } else {
                 /* You're not allowed to resize */
+                if (_watchdog_check(bd, extra))
+                    return false;
                 _e_border_resize(bd,
                                  extra->expected.w,
                                  extra->expected.h);
@@ -1508,28 +4125,28 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
             nextextra = eina_hash_find(_G.border_extras, &nextbd);
             if (!nextextra) {
                 ERR("No extra for %p", nextbd);
-                return;
+                return true;
             }
 
             if (_G.tinfo->conf->use_rows) {
-                int min_width = MAX(nextbd->client.icccm.base_w, 1);
                 int delta;
 
                 delta = bd->w - extra->expected.w;
-                if (nextextra->expected.w - delta < min_width)
-                    delta = nextextra->expected.w - min_width;
+                delta = _clamp_border_delta(bd, extra->expected.w,
+                                            nextbd, nextextra->expected.w,
+                                            delta);
 
                 nextextra->expected.x += delta;
                 nextextra->expected.w -= delta;
 
                 extra->expected.w += delta;
             } else {
-                int min_height = MAX(nextbd->client.icccm.base_h, 1);
                 int delta;
 
                 delta = bd->h - extra->expected.h;
-                if (nextextra->expected.h - delta < min_height)
-                    delta = nextextra->expected.h - min_height;
+                delta = _clamp_border_delta(bd, extra->expected.h,
+                                            nextbd, nextextra->expected.h,
+                                            delta);
 
                 nextextra->expected.y += delta;
                 nextextra->expected.h -= delta;
@@ -1552,6 +4169,8 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
       case TILING_MOVE:
         if (!l->prev) {
             /* You're not allowed to move */
+            if (_watchdog_check(bd, extra))
+                return false;
             if (_G.tinfo->conf->use_rows) {
                 bd->x = extra->expected.x;
             } else {
@@ -1568,15 +4187,14 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
             prevextra = eina_hash_find(_G.border_extras, &prevbd);
             if (!prevextra) {
                 ERR("No extra for %p", prevbd);
-                return;
+                return true;
             }
 
             if (_G.tinfo->conf->use_rows) {
                 int delta = bd->x - extra->expected.x;
-                int min_width = MAX(prevbd->client.icccm.base_w, 1);
 
-                if (prevextra->expected.w - delta < min_width)
-                    delta = prevextra->expected.w - min_width;
+                delta = _clamp_border_delta(prevbd, prevextra->expected.w,
+                                            bd, extra->expected.w, delta);
 
                 prevextra->expected.w += delta;
 
@@ -1584,10 +4202,9 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
                 extra->expected.w -= delta;
             } else {
                 int delta = bd->y - extra->expected.y;
-                int min_height = MAX(prevbd->client.icccm.base_h, 1);
 
-                if (prevextra->expected.h - delta < min_height)
-                    delta = prevextra->expected.h - min_height;
+                delta = _clamp_border_delta(prevbd, prevextra->expected.h,
+                                            bd, extra->expected.h, delta);
 
                 prevextra->expected.h += delta;
 
@@ -1607,12 +4224,28 @@ _move_resize_border_in_stack(E_Border *bd, Border_Extra *extra,
         break;
       default:
         ERR("invalid tiling change: %d", change);
+        return true;
     }
+
+    _update_weights_around(l);
+
+    return true;
 }
 
 /* }}} */
 /* Toggle Floating {{{ */
 
+/* Takes @bd out of its stack and gives it back its geometry, layer and
+ * border from before it was tiled */
+static void
+_float_border(E_Border *bd)
+{
+    _remove_border(bd);
+    _restore_border(bd);
+    if (!EINA_LIST_IS_IN(_G.tinfo->floating_windows, bd))
+        EINA_LIST_APPEND(_G.tinfo->floating_windows, bd);
+}
+
 static void
 toggle_floating(E_Border *bd)
 {
@@ -1627,8 +4260,7 @@ toggle_floating(E_Border *bd)
 
         _add_border(bd);
     } else {
-        _remove_border(bd);
-        _restore_border(bd);
+        _float_border(bd);
     }
 }
 
@@ -1653,7 +4285,8 @@ _action_swap(E_Border *bd_1,
     Eina_List *l_1 = NULL,
               *l_2 = NULL;
     geom_t gt;
-    unsigned int bd_2_maximized;
+    int weight;
+    E_Maximize maximize;
 
     extra_1 = eina_hash_find(_G.border_extras, &bd_1);
     if (!extra_1) {
@@ -1682,27 +4315,16 @@ _action_swap(E_Border *bd_1,
     gt = extra_2->expected;
     extra_2->expected = extra_1->expected;
     extra_1->expected = gt;
+    weight = extra_2->weight;
+    extra_2->weight = extra_1->weight;
+    extra_1->weight = weight;
 
-    bd_2_maximized = bd_2->maximized;
-    if (bd_2->maximized)
-        _e_border_unmaximize(bd_2, E_MAXIMIZE_BOTH);
-    if (bd_1->maximized) {
-        _e_border_unmaximize(bd_1, E_MAXIMIZE_BOTH);
-        _e_border_maximize(bd_2, bd_1->maximized);
-    }
-    if (bd_2_maximized) {
-        _e_border_maximize(bd_1, bd_2_maximized);
-    }
-    _e_border_move_resize(bd_1,
-                          extra_1->expected.x,
-                          extra_1->expected.y,
-                          extra_1->expected.w,
-                          extra_1->expected.h);
-    _e_border_move_resize(bd_2,
-                          extra_2->expected.x,
-                          extra_2->expected.y,
-                          extra_2->expected.w,
-                          extra_2->expected.h);
+    maximize = extra_2->maximize;
+    extra_2->maximize = extra_1->maximize;
+    extra_1->maximize = maximize;
+
+    _commit_border(bd_1, extra_1);
+    _commit_border(bd_2, extra_2);
 }
 
 static void
@@ -1731,12 +4353,44 @@ _e_mod_action_swap_cb(E_Object   *obj,
 /* }}} */
 /* Move {{{*/
 
+/* Shows the arrow of @dir centered on @x, @y of @bd's zone if the move
+ * is @possible, and hides it otherwise. Arrows are made the first time
+ * they are shown in a move session and only moved afterwards. */
+static void
+_move_arrow_update(tiling_move_t dir, const E_Border *bd, bool possible,
+                   int x, int y)
+{
+    overlay_t *overlay = &_G.move_overlays[dir];
+    overlay_type_t type = OVERLAY_MOVE_UP + dir;
+    Evas_Coord size[2];
+
+    if (!possible) {
+        _overlay_visible_set(overlay, false);
+        return;
+    }
+
+    if (!overlay->obj) {
+        if (!_overlay_acquire(overlay, bd->zone))
+            return;
+
+        _overlay_type_set(overlay, type);
+    }
+    _overlay_size_get(overlay->obj, type, NULL, &size[0], &size[1]);
+
+    _overlay_geometry_set(overlay,
+                          x - size[0] / 2 - overlay->zone->x,
+                          y - size[1] / 2 - overlay->zone->y,
+                          size[0], size[1]);
+    _overlay_visible_set(overlay, true);
+}
+
 static void
 _check_moving_anims(const E_Border *bd, const Border_Extra *extra, int stack)
 {
     Eina_List *l = NULL;
-    overlay_t *overlay;
+    const geom_t *g;
     int nb_stacks = get_stack_count();
+    bool next_stack;
 
     if (stack < 0) {
         stack = get_stack(bd);
@@ -1754,205 +4408,30 @@ _check_moving_anims(const E_Border *bd, const Border_Extra *extra, int stack)
     if (!l)
         return;
 
-    /* move left */
-    overlay = &_G.move_overlays[MOVE_LEFT];
-    if ((!_G.tinfo->conf->use_rows && stack > 0)
-    ||  (_G.tinfo->conf->use_rows && l->prev)) {
-        if (overlay->popup) {
-            Evas_Coord ew, eh;
-
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_move(_G.move_overlays[MOVE_LEFT].popup,
-                         extra->expected.x - ew/2,
-                         extra->expected.y + extra->expected.h/2 - eh/2);
-        } else {
-            Evas_Coord ew, eh;
-
-            overlay->popup = e_popup_new(bd->zone, 0, 0, 1, 1);
-            if (!overlay->popup)
-                return;
-
-            e_popup_layer_set(overlay->popup, TILING_POPUP_LAYER);
-            overlay->obj = edje_object_add(overlay->popup->evas);
-            _theme_edje_object_set(overlay->obj,
-                                   "modules/e-tiling/move/left");
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_edje_bg_object_set(overlay->popup,
-                                       overlay->obj);
-            evas_object_show(overlay->obj);
-            e_popup_move_resize(overlay->popup,
-                                extra->expected.x - ew/2
-                                                  - overlay->popup->zone->x,
-                                extra->expected.y + extra->expected.h/2
-                                                  - eh/2
-                                                  - overlay->popup->zone->y,
-                                ew,
-                                eh);
-            evas_object_resize(overlay->obj, ew, eh);
-
-            e_popup_show(overlay->popup);
-        }
-    } else if (overlay->popup) {
-        if (overlay->obj) {
-            evas_object_del(overlay->obj);
-            overlay->obj = NULL;
-        }
-        if (overlay->popup) {
-            e_object_del(E_OBJECT(overlay->popup));
-            overlay->popup = NULL;
-        }
-    }
-
-    /* move right */
-    overlay = &_G.move_overlays[MOVE_RIGHT];
-    if ((_G.tinfo->conf->use_rows && l->next)
-    || (!_G.tinfo->conf->use_rows && (
-            stack != TILING_MAX_STACKS - 1
-            && ((stack == nb_stacks - 1 && _G.tinfo->stacks[stack]->next)
-                || (stack != nb_stacks - 1))))) {
-        if (overlay->popup) {
-            Evas_Coord ew, eh;
-
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_move(_G.move_overlays[MOVE_RIGHT].popup,
-                         extra->expected.x + extra->expected.w - ew/2,
-                         extra->expected.y + extra->expected.h/2 - eh/2);
-        } else {
-            Evas_Coord ew, eh;
-
-            overlay->popup = e_popup_new(bd->zone, 0, 0, 1, 1);
-            if (!overlay->popup)
-                return;
-
-            e_popup_layer_set(overlay->popup, TILING_POPUP_LAYER);
-            overlay->obj = edje_object_add(overlay->popup->evas);
-            _theme_edje_object_set(overlay->obj,
-                                   "modules/e-tiling/move/right");
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_edje_bg_object_set(overlay->popup,
-                                       overlay->obj);
-            evas_object_show(overlay->obj);
-            e_popup_move_resize(overlay->popup,
-                                extra->expected.x + extra->expected.w - ew/2
-                                                  - overlay->popup->zone->x,
-                                extra->expected.y + extra->expected.h/2
-                                                  - eh/2
-                                                  - overlay->popup->zone->y,
-                                ew,
-                                eh);
-            evas_object_resize(overlay->obj, ew, eh);
-
-            e_popup_show(overlay->popup);
-        }
-    } else if (overlay->popup) {
-        if (overlay->obj) {
-            evas_object_del(overlay->obj);
-            overlay->obj = NULL;
-        }
-        if (overlay->popup) {
-            e_object_del(E_OBJECT(overlay->popup));
-            overlay->popup = NULL;
-        }
-    }
-
-    /* move up */
-    overlay = &_G.move_overlays[MOVE_UP];
-    if ((!_G.tinfo->conf->use_rows && l->prev)
-    ||  (_G.tinfo->conf->use_rows && stack > 0)) {
-        if (overlay->popup) {
-            Evas_Coord ew, eh;
-
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_move(_G.move_overlays[MOVE_UP].popup,
-                         extra->expected.x + extra->expected.w/2 - ew/2,
-                         extra->expected.y - eh/2);
-        } else {
-            Evas_Coord ew, eh;
-
-            overlay->popup = e_popup_new(bd->zone, 0, 0, 1, 1);
-            if (!overlay->popup)
-                return;
-
-            e_popup_layer_set(overlay->popup, TILING_POPUP_LAYER);
-            overlay->obj = edje_object_add(overlay->popup->evas);
-            _theme_edje_object_set(overlay->obj, "modules/e-tiling/move/up");
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_edje_bg_object_set(overlay->popup,
-                                       overlay->obj);
-            evas_object_show(overlay->obj);
-            e_popup_move_resize(overlay->popup,
-                                extra->expected.x + extra->expected.w/2
-                                                  - ew/2
-                                                  - overlay->popup->zone->x,
-                                extra->expected.y - eh/2
-                                                  - overlay->popup->zone->y,
-                                ew,
-                                eh);
-            evas_object_resize(overlay->obj, ew, eh);
-
-            e_popup_show(overlay->popup);
-        }
-    } else if (overlay->popup) {
-        if (overlay->obj) {
-            evas_object_del(overlay->obj);
-            overlay->obj = NULL;
-        }
-        if (overlay->popup) {
-            e_object_del(E_OBJECT(overlay->popup));
-            overlay->popup = NULL;
-        }
-    }
-
-    /* move down */
-    overlay = &_G.move_overlays[MOVE_DOWN];
-    if ((!_G.tinfo->conf->use_rows && l->next)
-    || (_G.tinfo->conf->use_rows && (
-            stack != TILING_MAX_STACKS - 1
-            && ((stack == nb_stacks - 1 && _G.tinfo->stacks[stack]->next)
-                || (stack != nb_stacks - 1))))) {
-        if (overlay->popup) {
-            Evas_Coord ew, eh;
-
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_move(_G.move_overlays[MOVE_DOWN].popup,
-                         extra->expected.x + extra->expected.w/2 - ew/2,
-                         extra->expected.y + extra->expected.h - eh/2);
-        } else {
-            Evas_Coord ew, eh;
-
-            overlay->popup = e_popup_new(bd->zone, 0, 0, 1, 1);
-            if (!overlay->popup)
-                return;
-
-            e_popup_layer_set(overlay->popup, TILING_POPUP_LAYER);
-            overlay->obj = edje_object_add(overlay->popup->evas);
-            _theme_edje_object_set(overlay->obj,
-                                   "modules/e-tiling/move/down");
-            edje_object_size_min_calc(overlay->obj, &ew, &eh);
-            e_popup_edje_bg_object_set(overlay->popup,
-                                       overlay->obj);
-            evas_object_show(overlay->obj);
-            e_popup_move_resize(overlay->popup,
-                                extra->expected.x + extra->expected.w/2
-                                                  - ew/2
-                                                  - overlay->popup->zone->x,
-                                extra->expected.y + extra->expected.h - eh/2
-                                                  - overlay->popup->zone->y,
-                                ew,
-                                eh);
-            evas_object_resize(overlay->obj, ew, eh);
+    g = &extra->expected;
+    /* Whether the window can go to the next stack, a new one if needed */
+    next_stack = stack != TILING_MAX_STACKS - 1
+              && ((stack == nb_stacks - 1 && _G.tinfo->stacks[stack]->next)
+                  || (stack != nb_stacks - 1));
 
-            e_popup_show(overlay->popup);
-        }
-    } else if (overlay->popup) {
-        if (overlay->obj) {
-            evas_object_del(overlay->obj);
-            overlay->obj = NULL;
-        }
-        if (overlay->popup) {
-            e_object_del(E_OBJECT(overlay->popup));
-            overlay->popup = NULL;
-        }
+    if (_G.tinfo->conf->use_rows) {
+        _move_arrow_update(MOVE_LEFT, bd, l->prev,
+                           g->x, g->y + g->h / 2);
+        _move_arrow_update(MOVE_RIGHT, bd, l->next,
+                           g->x + g->w, g->y + g->h / 2);
+        _move_arrow_update(MOVE_UP, bd, stack > 0,
+                           g->x + g->w / 2, g->y);
+        _move_arrow_update(MOVE_DOWN, bd, next_stack,
+                           g->x + g->w / 2, g->y + g->h);
+    } else {
+        _move_arrow_update(MOVE_LEFT, bd, stack > 0,
+                           g->x, g->y + g->h / 2);
+        _move_arrow_update(MOVE_RIGHT, bd, next_stack,
+                           g->x + g->w, g->y + g->h / 2);
+        _move_arrow_update(MOVE_UP, bd, l->prev,
+                           g->x + g->w / 2, g->y);
+        _move_arrow_update(MOVE_DOWN, bd, l->next,
+                           g->x + g->w / 2, g->y + g->h);
     }
 }
 
@@ -2075,30 +4554,21 @@ _move_left_cols(void)
 
     EINA_LIST_REMOVE(_G.tinfo->stacks[stack], bd);
     EINA_LIST_APPEND(_G.tinfo->stacks[stack - 1], bd);
+    _forget_weight(bd);
 
     if (!_G.tinfo->stacks[stack]) {
-        int x, y, w, h;
-        int width = 0;
         int nb_stacks;
 
         /* Remove stack */
         nb_stacks = get_stack_count();
 
-        e_zone_useful_geometry_get(bd->zone, &x, &y, &w, &h);
-
         for (int i = stack; i < nb_stacks; i++) {
             _G.tinfo->stacks[i] = _G.tinfo->stacks[i+1];
         }
         _G.tinfo->stacks[nb_stacks] = NULL;
-        for (int i = 0; i < nb_stacks; i++) {
-
-            width = w / (nb_stacks - i);
-
-            _set_stack_geometry(i, x, width);
-
-            w -= width;
-            x += width;
-        }
+        _split_stacks(nb_stacks);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
         _reorganize_stack(stack - 1);
     } else {
         _reorganize_stack(stack);
@@ -2141,6 +4611,7 @@ _move_right_cols(void)
 
     EINA_LIST_REMOVE(_G.tinfo->stacks[stack], bd);
     EINA_LIST_APPEND(_G.tinfo->stacks[stack + 1], bd);
+    _forget_weight(bd);
 
     if (_G.tinfo->stacks[stack] && _G.tinfo->stacks[stack + 1]->next) {
         _reorganize_stack(stack);
@@ -2150,34 +4621,24 @@ _move_right_cols(void)
     if (_G.tinfo->stacks[stack]) {
         /* Add stack */
         int x, y, w, h;
-        int width = 0;
+        int width;
 
         _reorganize_stack(stack);
 
         e_zone_useful_geometry_get(bd->zone, &x, &y, &w, &h);
 
-        for (int i = 0; i < nb_stacks; i++) {
-
-            width = w / (nb_stacks + 1 - i);
+        _split_stacks(nb_stacks + 1);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
+        x = _G.tinfo->pos[nb_stacks];
+        width = _G.tinfo->size[nb_stacks];
 
-            _set_stack_geometry(i, x, width);
-
-            w -= width;
-            x += width;
-        }
-
-        _G.tinfo->pos[nb_stacks] = x;
-        _G.tinfo->size[nb_stacks] = width;
         extra->expected.x = x;
         extra->expected.y = y;
         extra->expected.w = width;
         extra->expected.h = h;
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
-        _e_border_maximize(bd, E_MAXIMIZE_EXPAND | E_MAXIMIZE_VERTICAL);
+        extra->maximize = _desired_maximize(nb_stacks, 1);
+        _commit_border(bd, extra);
 
         if (nb_stacks + 1 > _G.tinfo->conf->nb_stacks) {
             _G.tinfo->conf->nb_stacks = nb_stacks + 1;
@@ -2185,22 +4646,13 @@ _move_right_cols(void)
         }
         _check_moving_anims(bd, extra, stack + 1);
     } else {
-        int x, y, w, h;
-        int width;
-
-        e_zone_useful_geometry_get(_G.tinfo->desk->zone, &x, &y, &w, &h);
         for (int i = stack; i < nb_stacks; i++) {
              _G.tinfo->stacks[i] = _G.tinfo->stacks[i + 1];
         }
         nb_stacks--;
-        for (int i = 0; i < nb_stacks; i++) {
-            width = w / (nb_stacks - i);
-
-            _set_stack_geometry(i, x, width);
-
-            w -= width;
-            x += width;
-        }
+        _split_stacks(nb_stacks);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
         _G.tinfo->stacks[nb_stacks] = NULL;
         _G.tinfo->pos[nb_stacks] = 0;
         _G.tinfo->size[nb_stacks] = 0;
@@ -2332,30 +4784,21 @@ _move_up_rows(void)
 
     EINA_LIST_REMOVE(_G.tinfo->stacks[stack], bd);
     EINA_LIST_APPEND(_G.tinfo->stacks[stack - 1], bd);
+    _forget_weight(bd);
 
     if (!_G.tinfo->stacks[stack]) {
-        int x, y, w, h;
         int nb_stacks;
 
         /* Remove stack */
         nb_stacks = get_stack_count();
 
-        e_zone_useful_geometry_get(bd->zone, &x, &y, &w, &h);
-
         for (int i = stack; i < nb_stacks; i++) {
             _G.tinfo->stacks[i] = _G.tinfo->stacks[i+1];
         }
         _G.tinfo->stacks[nb_stacks] = NULL;
-        for (int i = 0; i < nb_stacks; i++) {
-            int height = 0;
-
-            height = h / (nb_stacks - i);
-
-            _set_stack_geometry(i, y, height);
-
-            h -= height;
-            y += height;
-        }
+        _split_stacks(nb_stacks);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
         _reorganize_stack(stack - 1);
     } else {
         _reorganize_stack(stack);
@@ -2398,6 +4841,7 @@ _move_down_rows(void)
 
     EINA_LIST_REMOVE(_G.tinfo->stacks[stack], bd);
     EINA_LIST_APPEND(_G.tinfo->stacks[stack + 1], bd);
+    _forget_weight(bd);
 
     if (_G.tinfo->stacks[stack] && _G.tinfo->stacks[stack + 1]->next) {
         _reorganize_stack(stack);
@@ -2407,34 +4851,24 @@ _move_down_rows(void)
     if (_G.tinfo->stacks[stack]) {
         /* Add stack */
         int x, y, w, h;
-        int height = 0;
+        int height;
 
         _reorganize_stack(stack);
 
         e_zone_useful_geometry_get(bd->zone, &x, &y, &w, &h);
 
-        for (int i = 0; i < nb_stacks; i++) {
-
-            height = h / (nb_stacks + 1 - i);
-
-            _set_stack_geometry(i, y, height);
-
-            h -= height;
-            y += height;
-        }
+        _split_stacks(nb_stacks + 1);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
+        y = _G.tinfo->pos[nb_stacks];
+        height = _G.tinfo->size[nb_stacks];
 
-        _G.tinfo->pos[nb_stacks] = y;
-        _G.tinfo->size[nb_stacks] = height;
         extra->expected.x = x;
         extra->expected.y = y;
         extra->expected.w = w;
         extra->expected.h = height;
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
-        _e_border_maximize(bd, E_MAXIMIZE_EXPAND | E_MAXIMIZE_HORIZONTAL);
+        extra->maximize = _desired_maximize(nb_stacks, 1);
+        _commit_border(bd, extra);
 
         if (nb_stacks + 1 > _G.tinfo->conf->nb_stacks) {
             _G.tinfo->conf->nb_stacks = nb_stacks + 1;
@@ -2442,23 +4876,13 @@ _move_down_rows(void)
         }
         _check_moving_anims(bd, extra, stack + 1);
     } else {
-        int x, y, w, h;
-
-        e_zone_useful_geometry_get(_G.tinfo->desk->zone, &x, &y, &w, &h);
         for (int i = stack; i < nb_stacks; i++) {
              _G.tinfo->stacks[i] = _G.tinfo->stacks[i + 1];
         }
         nb_stacks--;
-        for (int i = 0; i < nb_stacks; i++) {
-            int height;
-
-            height = h / (nb_stacks - i);
-
-            _set_stack_geometry(i, y, height);
-
-            h -= height;
-            y += height;
-        }
+        _split_stacks(nb_stacks);
+        for (int i = 0; i < nb_stacks; i++)
+            _set_stack_geometry(i, _G.tinfo->pos[i], _G.tinfo->size[i]);
         _G.tinfo->stacks[nb_stacks] = NULL;
         _G.tinfo->pos[nb_stacks] = 0;
         _G.tinfo->size[nb_stacks] = 0;
@@ -2584,187 +5008,222 @@ _transition_overlays_free_cb(void *data)
 {
     transition_overlay_t *trov = data;
 
-    if (trov->overlay.obj) {
-        evas_object_del(trov->overlay.obj);
-        trov->overlay.obj = NULL;
-    }
-    if (trov->overlay.popup) {
-        e_object_del(E_OBJECT(trov->overlay.popup));
-        trov->overlay.popup = NULL;
-    }
+    _overlay_release(&trov->overlay);
     if (trov != _G.transition_overlay) {
         E_FREE(trov);
     }
 }
 
-static void
-_transition_move_cols(tiling_move_t direction)
+/* Whether the boundary after @bd, or after its stack when @bd is NULL,
+ * moves along the y axis */
+static bool
+_boundary_vertical(const E_Border *bd)
 {
-    int delta = TILING_RESIZE_STEP;
-    int stack;
-    E_Popup *popup = NULL;
-
-    if (!_G.transition_overlay)
-        return;
-
-    stack = _G.transition_overlay->stack;
+    return !!bd != !!_G.tinfo->conf->use_rows;
+}
 
-    if (_G.transition_overlay->bd) {
-        Eina_List *l = NULL;
-        E_Border *bd = _G.transition_overlay->bd,
-                 *nextbd = NULL;
-        Border_Extra *extra = NULL,
-                     *nextextra = NULL;
-        int min_height = 0;
+/* Moves the boundary between @bd and the next window of @stack, or
+ * between @stack and the next stack when @bd is NULL, by @delta pixels
+ * or as much as the windows on both sides allow. Returns the distance
+ * it was moved by. */
+static int
+_boundary_move(int stack, E_Border *bd, int delta)
+{
+    if (bd) {
+        Eina_List *l;
+        E_Border *nextbd;
+        Border_Extra *extra,
+                     *nextextra;
 
         l = eina_list_data_find_list(_G.tinfo->stacks[stack], bd);
-        if (!l) {
+        if (!l || !l->next) {
             ERR("unable to bd %p in stack %d", bd, stack);
-            return;
+            return 0;
         }
 
         extra = eina_hash_find(_G.border_extras, &bd);
         if (!extra) {
             ERR("No extra for %p", bd);
-            return;
+            return 0;
         }
         nextbd = l->next->data;
         nextextra = eina_hash_find(_G.border_extras, &nextbd);
         if (!nextextra) {
             ERR("No extra for %p", nextbd);
-            return;
+            return 0;
         }
 
-        if (direction == MOVE_UP) {
-            delta *= -1;
+        if (_boundary_vertical(bd)) {
+            delta = _clamp_border_delta(bd, extra->expected.h,
+                                        nextbd, nextextra->expected.h,
+                                        delta);
+            nextextra->expected.y += delta;
+            nextextra->expected.h -= delta;
+            extra->expected.h += delta;
+        } else {
+            delta = _clamp_border_delta(bd, extra->expected.w,
+                                        nextbd, nextextra->expected.w,
+                                        delta);
+            nextextra->expected.x += delta;
+            nextextra->expected.w -= delta;
+            extra->expected.w += delta;
         }
+        if (!delta)
+            return 0;
 
-        nextbd = l->next->data;
-        min_height = MAX(nextbd->client.icccm.base_h, 1);
-
-        if (nextextra->expected.h - delta < min_height)
-            delta = nextextra->expected.h - min_height;
-
-        nextextra->expected.y += delta;
-        nextextra->expected.h -= delta;
         _e_border_move_resize(nextbd,
                               nextextra->expected.x,
                               nextextra->expected.y,
                               nextextra->expected.w,
                               nextextra->expected.h);
-
-        extra->expected.h += delta;
         _e_border_move_resize(bd,
                               extra->expected.x,
                               extra->expected.y,
                               extra->expected.w,
                               extra->expected.h);
-
-        popup = _G.transition_overlay->overlay.popup;
-        e_popup_move(popup, popup->x, popup->y + delta);
+        _update_weights_around(l);
     } else {
+        if (stack + 1 >= TILING_MAX_STACKS || !_G.tinfo->stacks[stack + 1])
+            return 0;
 
-        if (stack == TILING_MAX_STACKS || !_G.tinfo->stacks[stack + 1]) {
-            return;
-        }
-        if (direction == MOVE_LEFT) {
-            delta *= -1;
-        }
-
-        if (delta + 1 > _G.tinfo->size[stack + 1])
-            delta = _G.tinfo->size[stack + 1] - 1;
+        delta = _clamp_stack_delta(stack, stack + 1, delta);
+        if (!delta)
+            return 0;
 
         _move_resize_stack(stack, 0, delta);
         _move_resize_stack(stack+1, delta, -delta);
+    }
+
+    return delta;
+}
+
+/* Gives where the two sides of the boundary after @bd in @stack, or
+ * after @stack when @bd is NULL, start, meet and end along the axis the
+ * boundary moves on. Returns false if there is no such boundary. */
+static bool
+_boundary_get(int stack, E_Border *bd, int *start, int *pos, int *end)
+{
+    if (bd) {
+        Eina_List *l = eina_list_data_find_list(_G.tinfo->stacks[stack], bd);
+        E_Border *nextbd;
+        Border_Extra *extra,
+                     *nextextra;
+
+        if (!l || !l->next)
+            return false;
+        nextbd = l->next->data;
+        extra = eina_hash_find(_G.border_extras, &bd);
+        nextextra = eina_hash_find(_G.border_extras, &nextbd);
+        if (!extra || !nextextra)
+            return false;
+
+        if (_boundary_vertical(bd)) {
+            *start = extra->expected.y;
+            *pos = extra->expected.y + extra->expected.h;
+            *end = nextextra->expected.y + nextextra->expected.h;
+        } else {
+            *start = extra->expected.x;
+            *pos = extra->expected.x + extra->expected.w;
+            *end = nextextra->expected.x + nextextra->expected.w;
+        }
+    } else {
+        if (stack + 1 >= TILING_MAX_STACKS || !_G.tinfo->stacks[stack + 1])
+            return false;
+
+        *start = _G.tinfo->pos[stack];
+        *pos = _G.tinfo->pos[stack] + _G.tinfo->size[stack];
+        *end = _G.tinfo->pos[stack + 1] + _G.tinfo->size[stack + 1];
+    }
+
+    return true;
+}
+
+/* Moves the boundary of the transition overlay by the moves queued
+ * since the last frame, at once */
+static void
+_transition_adjust_flush(void)
+{
+    transition_overlay_t *trov = _G.transition_overlay;
+    int delta = _G.adjust.delta;
+
+    _G.adjust.delta = 0;
+    if (_G.adjust.animator) {
+        ecore_animator_del(_G.adjust.animator);
+        _G.adjust.animator = NULL;
+    }
+    if (!trov || !delta)
+        return;
+
+    delta = _boundary_move(trov->stack, trov->bd, delta);
+    if (_boundary_vertical(trov->bd))
+        _overlay_move_by(&trov->overlay, 0, delta);
+    else
+        _overlay_move_by(&trov->overlay, delta, 0);
+}
 
-        popup = _G.transition_overlay->overlay.popup;
-        e_popup_move(popup, popup->x + delta, popup->y);
-    }
+static Eina_Bool
+_transition_adjust_cb(void *data)
+{
+    _G.adjust.animator = NULL;
+    _transition_adjust_flush();
+
+    return ECORE_CALLBACK_CANCEL;
 }
 
+/* Queues a move of the boundary of the transition overlay for a key
+ * pressed at @timestamp in @direction: by a step growing while the key
+ * is repeated, or up to the next common ratio of both sides if @snap.
+ * Moves queued within a frame are applied together. */
 static void
-_transition_move_rows(tiling_move_t direction)
+_transition_move(tiling_move_t direction, unsigned int timestamp, bool snap)
 {
-    int delta = TILING_RESIZE_STEP;
-    int stack;
-    E_Popup *popup = NULL;
-
-    if (!_G.transition_overlay)
+    static const double ratios[] = {
+        1.0 / 4, 1.0 / 3, 1.0 / 2, 2.0 / 3, 3.0 / 4,
+    };
+    const int nb_ratios = sizeof(ratios) / sizeof(ratios[0]);
+    transition_overlay_t *trov = _G.transition_overlay;
+    int sign = 1;
+
+    if (!trov)
         return;
 
-    stack = _G.transition_overlay->stack;
+    if (direction == MOVE_UP || direction == MOVE_LEFT)
+        sign = -1;
 
-    if (_G.transition_overlay->bd) {
-        Eina_List *l = NULL;
-        E_Border *bd = _G.transition_overlay->bd,
-                 *nextbd = NULL;
-        Border_Extra *extra = NULL,
-                     *nextextra = NULL;
-        int min_width = 0;
+    if (direction == _G.adjust.direction
+    &&  timestamp - _G.adjust.timestamp < TILING_KEY_REPEAT_DELAY)
+        _G.adjust.repeats++;
+    else
+        _G.adjust.repeats = 0;
+    _G.adjust.direction = direction;
+    _G.adjust.timestamp = timestamp;
 
-        l = eina_list_data_find_list(_G.tinfo->stacks[stack], bd);
-        if (!l) {
-            ERR("unable to bd %p in stack %d", bd, stack);
-            return;
-        }
+    if (snap) {
+        int start, pos, end;
 
-        extra = eina_hash_find(_G.border_extras, &bd);
-        if (!extra) {
-            ERR("No extra for %p", bd);
-            return;
-        }
-        nextbd = l->next->data;
-        nextextra = eina_hash_find(_G.border_extras, &nextbd);
-        if (!nextextra) {
-            ERR("No extra for %p", nextbd);
+        if (!_boundary_get(trov->stack, trov->bd, &start, &pos, &end)
+        ||  end <= start)
             return;
-        }
-
-        if (direction == MOVE_LEFT) {
-            delta *= -1;
-        }
-
-        nextbd = l->next->data;
-        min_width = MAX(nextbd->client.icccm.base_w, 1);
-
-        if (nextextra->expected.w - delta < min_width)
-            delta = nextextra->expected.w - min_width;
-
-        nextextra->expected.x += delta;
-        nextextra->expected.w -= delta;
-        _e_border_move_resize(nextbd,
-                              nextextra->expected.x,
-                              nextextra->expected.y,
-                              nextextra->expected.w,
-                              nextextra->expected.h);
-
-        extra->expected.w += delta;
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
 
-        popup = _G.transition_overlay->overlay.popup;
-        e_popup_move(popup, popup->x + delta, popup->y);
-    } else {
+        pos += _G.adjust.delta;
+        for (int i = 0; i < nb_ratios; i++) {
+            double ratio = ratios[sign > 0 ? i : nb_ratios - 1 - i];
+            int target = start + (int)((end - start) * ratio + 0.5);
 
-        if (stack == TILING_MAX_STACKS || !_G.tinfo->stacks[stack + 1]) {
-            return;
-        }
-        if (direction == MOVE_UP) {
-            delta *= -1;
+            if ((target - pos) * sign > 0) {
+                _G.adjust.delta += target - pos;
+                break;
+            }
         }
+    } else {
+        int shift = MIN(_G.adjust.repeats / TILING_KEY_ACCEL_REPEATS,
+                        TILING_KEY_ACCEL_MAX);
 
-        if (delta + 1 > _G.tinfo->size[stack + 1])
-            delta = _G.tinfo->size[stack + 1] - 1;
-
-        _move_resize_stack(stack, 0, delta);
-        _move_resize_stack(stack+1, delta, -delta);
-
-        popup = _G.transition_overlay->overlay.popup;
-        e_popup_move(popup, popup->x, popup->y + delta);
+        _G.adjust.delta += sign * (TILING_RESIZE_STEP << shift);
     }
+
+    if (_G.adjust.delta && !_G.adjust.animator)
+        _G.adjust.animator = ecore_animator_add(_transition_adjust_cb, NULL);
 }
 
 static Eina_Bool
@@ -2787,82 +5246,59 @@ _transition_overlay_key_down(void *data,
                       - ecore_timer_pending_get(_G.action_timer));
 
     if (_G.transition_overlay) {
+        bool vertical = _boundary_vertical(_G.transition_overlay->bd);
+        bool snap = ev->modifiers & ECORE_EVENT_MODIFIER_SHIFT;
+
         DBG("ev->key='%s'; %p %d", ev->key,
             _G.transition_overlay->bd, _G.tinfo->conf->use_rows);
         if ((strcmp(ev->key, "Up") == 0)
-            ||  (strcmp(ev->key, "k") == 0))
+        ||  (strcasecmp(ev->key, "k") == 0))
         {
-            if (_G.transition_overlay->bd && !_G.tinfo->conf->use_rows) {
-                _transition_move_cols(MOVE_UP);
-                return ECORE_CALLBACK_PASS_ON;
-            } else
-            if (!_G.transition_overlay->bd && _G.tinfo->conf->use_rows) {
-                _transition_move_rows(MOVE_UP);
+            if (vertical) {
+                _transition_move(MOVE_UP, ev->timestamp, snap);
                 return ECORE_CALLBACK_PASS_ON;
             }
         } else
         if ((strcmp(ev->key, "Down") == 0)
-        ||  (strcmp(ev->key, "j") == 0))
+        ||  (strcasecmp(ev->key, "j") == 0))
         {
-            if (_G.transition_overlay->bd && !_G.tinfo->conf->use_rows) {
-                _transition_move_cols(MOVE_DOWN);
-                return ECORE_CALLBACK_PASS_ON;
-            } else
-            if (!_G.transition_overlay->bd && _G.tinfo->conf->use_rows) {
-                _transition_move_rows(MOVE_DOWN);
+            if (vertical) {
+                _transition_move(MOVE_DOWN, ev->timestamp, snap);
                 return ECORE_CALLBACK_PASS_ON;
             }
         } else
         if ((strcmp(ev->key, "Left") == 0)
-        ||  (strcmp(ev->key, "h") == 0))
+        ||  (strcasecmp(ev->key, "h") == 0))
         {
-            if (!_G.transition_overlay->bd && !_G.tinfo->conf->use_rows) {
-                _transition_move_cols(MOVE_LEFT);
-                return ECORE_CALLBACK_PASS_ON;
-            } else
-            if (_G.transition_overlay->bd && _G.tinfo->conf->use_rows) {
-                _transition_move_rows(MOVE_LEFT);
+            if (!vertical) {
+                _transition_move(MOVE_LEFT, ev->timestamp, snap);
                 return ECORE_CALLBACK_PASS_ON;
             }
         } else
         if ((strcmp(ev->key, "Right") == 0)
-        ||  (strcmp(ev->key, "l") == 0))
+        ||  (strcasecmp(ev->key, "l") == 0))
         {
-            if (!_G.transition_overlay->bd && !_G.tinfo->conf->use_rows) {
-                _transition_move_cols(MOVE_RIGHT);
-                return ECORE_CALLBACK_PASS_ON;
-            } else
-            if (_G.transition_overlay->bd && _G.tinfo->conf->use_rows) {
-                _transition_move_rows(MOVE_RIGHT);
+            if (!vertical) {
+                _transition_move(MOVE_RIGHT, ev->timestamp, snap);
                 return ECORE_CALLBACK_PASS_ON;
             }
         }
 
         return ECORE_CALLBACK_RENEW;
     } else {
-        if (strcmp(ev->key, "Backspace") == 0) {
-            char *key = _G.keys;
-
-            while (*key)
-                key++;
-            *key = '\0';
+        if (strcmp(ev->key, "BackSpace") == 0) {
+            _hints_back();
             return ECORE_CALLBACK_RENEW;
         }
-        if (ev->key[0] && !ev->key[1] && strchr(tiling_g.config->keyhints,
-                                                ev->key[1]))
+        if (ev->string && ev->string[0] && !ev->string[1])
         {
             transition_overlay_t *trov = NULL;
             E_Border *bd = NULL;
             Border_Extra *extra = NULL;
+            overlay_type_t type;
             Evas_Coord ew, eh;
-            char *key = _G.keys;
 
-            while (*key)
-                key++;
-            *key++ = ev->key[0];
-            *key = '\0';
-
-            trov = eina_hash_find(_G.overlays, _G.keys);
+            trov = _hints_feed(ev->string[0]);
             if (!trov) {
                 return ECORE_CALLBACK_RENEW;
             }
@@ -2871,6 +5307,7 @@ _transition_overlay_key_down(void *data,
             _G.transition_overlay = trov;
             eina_hash_free(_G.overlays);
             _G.overlays = NULL;
+            _hints_free();
 
             if (bd) {
                 extra = eina_hash_find(_G.border_extras, &bd);
@@ -2879,63 +5316,52 @@ _transition_overlay_key_down(void *data,
                     goto stop;
                 }
             }
-            if (!trov->overlay.popup) {
-                trov->overlay.popup = e_popup_new(_G.tinfo->desk->zone,
-                                                  0, 0, 1, 1);
-                e_popup_layer_set(trov->overlay.popup, TILING_POPUP_LAYER);
-            }
-            if (!trov->overlay.obj) {
-                trov->overlay.obj =
-                    edje_object_add(trov->overlay.popup->evas);
-            }
+            if (!trov->overlay.obj
+            &&  !_overlay_acquire(&trov->overlay, _G.tinfo->desk->zone))
+                goto stop;
             if ((bd && !_G.tinfo->conf->use_rows)
             ||  (!bd && _G.tinfo->conf->use_rows)) {
-                _theme_edje_object_set(trov->overlay.obj,
-                                       "modules/e-tiling/transition/horizontal");
+                type = OVERLAY_TRANSITION_HORIZONTAL;
             } else {
-                _theme_edje_object_set(trov->overlay.obj,
-                                       "modules/e-tiling/transition/vertical");
+                type = OVERLAY_TRANSITION_VERTICAL;
             }
+            _overlay_type_set(&trov->overlay, type);
 
-            edje_object_size_min_calc(trov->overlay.obj, &ew, &eh);
-            e_popup_edje_bg_object_set(trov->overlay.popup,
-                                       trov->overlay.obj);
-            evas_object_show(trov->overlay.obj);
+            _overlay_size_get(trov->overlay.obj, type, NULL, &ew, &eh);
             if (bd) {
                 if (_G.tinfo->conf->use_rows) {
-                    e_popup_move_resize(trov->overlay.popup,
-                        (extra->expected.x - trov->overlay.popup->zone->x +
+                    _overlay_geometry_set(&trov->overlay,
+                        (extra->expected.x - trov->overlay.zone->x +
                             extra->expected.w - (ew / 2)),
-                        (extra->expected.y - trov->overlay.popup->zone->y +
+                        (extra->expected.y - trov->overlay.zone->y +
                             ((extra->expected.h - eh) / 2)),
                         ew, eh);
                 } else {
-                    e_popup_move_resize(trov->overlay.popup,
-                        (extra->expected.x - trov->overlay.popup->zone->x +
+                    _overlay_geometry_set(&trov->overlay,
+                        (extra->expected.x - trov->overlay.zone->x +
                             ((extra->expected.w - ew) / 2)),
-                        (extra->expected.y - trov->overlay.popup->zone->y +
+                        (extra->expected.y - trov->overlay.zone->y +
                             extra->expected.h - (eh / 2)),
                         ew, eh);
                 }
             } else {
                 if (_G.tinfo->conf->use_rows) {
-                    e_popup_move_resize(trov->overlay.popup,
-                                        (trov->overlay.popup->zone->w/2 - ew/2),
-                                        (_G.tinfo->pos[trov->stack]
-                                         + _G.tinfo->size[trov->stack]
-                                         - trov->overlay.popup->zone->y - eh/2),
-                                        ew, eh);
+                    _overlay_geometry_set(&trov->overlay,
+                                          (trov->overlay.zone->w/2 - ew/2),
+                                          (_G.tinfo->pos[trov->stack]
+                                           + _G.tinfo->size[trov->stack]
+                                           - trov->overlay.zone->y - eh/2),
+                                          ew, eh);
                 } else {
-                    e_popup_move_resize(trov->overlay.popup,
-                                        (_G.tinfo->pos[trov->stack]
-                                         + _G.tinfo->size[trov->stack]
-                                         - trov->overlay.popup->zone->x - ew/2),
-                                        (trov->overlay.popup->zone->h/2 - eh/2),
-                                        ew, eh);
+                    _overlay_geometry_set(&trov->overlay,
+                                          (_G.tinfo->pos[trov->stack]
+                                           + _G.tinfo->size[trov->stack]
+                                           - trov->overlay.zone->x - ew/2),
+                                          (trov->overlay.zone->h/2 - eh/2),
+                                          ew, eh);
                 }
             }
-            evas_object_resize(trov->overlay.obj, ew, eh);
-            e_popup_show(trov->overlay.popup);
+            _overlay_visible_set(&trov->overlay, true);
 
             return ECORE_CALLBACK_RENEW;
         }
@@ -2951,8 +5377,6 @@ _do_transition_overlay(void)
 {
     int nb_transitions;
     Ecore_X_Window parent;
-    int hints_len;
-    int key_len;
     int n = 0;
     int nmax;
 
@@ -2966,18 +5390,7 @@ _do_transition_overlay(void)
     _G.input_mode = INPUT_MODE_TRANSITION;
 
     _G.overlays = eina_hash_string_small_new(_transition_overlays_free_cb);
-    hints_len = strlen(tiling_g.config->keyhints);
-    key_len = 1;
-    nmax = hints_len;
-    if (hints_len < nb_transitions) {
-        key_len = 2;
-        nmax *= hints_len;
-        if (hints_len * hints_len < nb_transitions) {
-            key_len = 3;
-            nmax *= hints_len;
-        }
-    }
-
+    nmax = _hints_build(nb_transitions, NULL, NULL);
 
     for (int i = 0; i < TILING_MAX_STACKS; i++) {
         Eina_List *l;
@@ -2999,33 +5412,15 @@ _do_transition_overlay(void)
 
                 trov = E_NEW(transition_overlay_t, 1);
 
-                trov->overlay.popup = e_popup_new(bd->zone, 0, 0, 1, 1);
-                if (!trov->overlay.popup)
+                if (!_overlay_acquire(&trov->overlay, bd->zone)) {
+                    E_FREE(trov);
                     continue;
-
-                e_popup_layer_set(trov->overlay.popup, TILING_POPUP_LAYER);
-                trov->overlay.obj = edje_object_add(trov->overlay.popup->evas);
-                e_theme_edje_object_set(trov->overlay.obj,
-                                        "base/theme/borders",
-                                        "e/widgets/border/default/resize");
-
-                switch (key_len) {
-                  case 1:
-                    trov->key[0] = tiling_g.config->keyhints[n];
-                    trov->key[1] = '\0';
-                    break;
-                  case 2:
-                    trov->key[0] = tiling_g.config->keyhints[n / hints_len];
-                    trov->key[1] = tiling_g.config->keyhints[n % hints_len];
-                    trov->key[2] = '\0';
-                    break;
-                  case 3:
-                    trov->key[0] = tiling_g.config->keyhints[n / hints_len / hints_len];
-                    trov->key[0] = tiling_g.config->keyhints[n / hints_len];
-                    trov->key[1] = tiling_g.config->keyhints[n % hints_len];
-                    trov->key[2] = '\0';
-                    break;
                 }
+
+                _overlay_type_set(&trov->overlay, OVERLAY_HINT);
+
+                _hints_code(n, trov->key);
+                _hints_set(n, trov, &trov->overlay);
                 n++;
                 trov->stack = i;
                 trov->bd = bd;
@@ -3034,33 +5429,24 @@ _do_transition_overlay(void)
                 edje_object_part_text_set(trov->overlay.obj,
                                           "e.text.label",
                                           trov->key);
-                edje_object_size_min_calc(trov->overlay.obj, &ew, &eh);
-                evas_object_move(trov->overlay.obj, 0, 0);
-                evas_object_resize(trov->overlay.obj, ew, eh);
-                evas_object_show(trov->overlay.obj);
-                e_popup_edje_bg_object_set(trov->overlay.popup,
-                                           trov->overlay.obj);
-
-                evas_object_show(trov->overlay.obj);
-                e_popup_show(trov->overlay.popup);
-
+                _overlay_size_get(trov->overlay.obj, OVERLAY_HINT, trov->key,
+                                  &ew, &eh);
                 if (_G.tinfo->conf->use_rows) {
-                    e_popup_move_resize(trov->overlay.popup,
-                        (extra->expected.x - trov->overlay.popup->zone->x +
+                    _overlay_geometry_set(&trov->overlay,
+                        (extra->expected.x - trov->overlay.zone->x +
                             extra->expected.w - (ew / 2)),
-                        (extra->expected.y - trov->overlay.popup->zone->y +
+                        (extra->expected.y - trov->overlay.zone->y +
                             ((extra->expected.h - eh) / 2)),
                         ew, eh);
                 } else {
-                    e_popup_move_resize(trov->overlay.popup,
-                        (extra->expected.x - trov->overlay.popup->zone->x +
+                    _overlay_geometry_set(&trov->overlay,
+                        (extra->expected.x - trov->overlay.zone->x +
                             ((extra->expected.w - ew) / 2)),
-                        (extra->expected.y - trov->overlay.popup->zone->y +
+                        (extra->expected.y - trov->overlay.zone->y +
                             extra->expected.h - (eh / 2)),
                         ew, eh);
                 }
-
-                e_popup_show(trov->overlay.popup);
+                _overlay_visible_set(&trov->overlay, true);
             }
         }
         if (i != TILING_MAX_STACKS && _G.tinfo->stacks[i+1] && n < nmax) {
@@ -3069,34 +5455,15 @@ _do_transition_overlay(void)
 
             trov = E_NEW(transition_overlay_t, 1);
 
-            trov->overlay.popup = e_popup_new(_G.tinfo->desk->zone,
-                                              0, 0, 1, 1);
-            if (!trov->overlay.popup)
+            if (!_overlay_acquire(&trov->overlay, _G.tinfo->desk->zone)) {
+                E_FREE(trov);
                 continue;
+            }
 
-            e_popup_layer_set(trov->overlay.popup, TILING_POPUP_LAYER);
-            trov->overlay.obj = edje_object_add(trov->overlay.popup->evas);
-            e_theme_edje_object_set(trov->overlay.obj,
-                                    "base/theme/borders",
-                                    "e/widgets/border/default/resize");
+            _overlay_type_set(&trov->overlay, OVERLAY_HINT);
 
-            switch (key_len) {
-              case 1:
-                trov->key[0] = tiling_g.config->keyhints[n];
-                trov->key[1] = '\0';
-                break;
-              case 2:
-                trov->key[0] = tiling_g.config->keyhints[n / hints_len];
-                trov->key[1] = tiling_g.config->keyhints[n % hints_len];
-                trov->key[2] = '\0';
-                break;
-              case 3:
-                trov->key[0] = tiling_g.config->keyhints[n / hints_len / hints_len];
-                trov->key[0] = tiling_g.config->keyhints[n / hints_len];
-                trov->key[1] = tiling_g.config->keyhints[n % hints_len];
-                trov->key[2] = '\0';
-                break;
-            }
+            _hints_code(n, trov->key);
+            _hints_set(n, trov, &trov->overlay);
             n++;
             trov->stack = i;
             trov->bd = NULL;
@@ -3105,33 +5472,24 @@ _do_transition_overlay(void)
             edje_object_part_text_set(trov->overlay.obj,
                                       "e.text.label",
                                       trov->key);
-            edje_object_size_min_calc(trov->overlay.obj, &ew, &eh);
-            evas_object_move(trov->overlay.obj, 0, 0);
-            evas_object_resize(trov->overlay.obj, ew, eh);
-            evas_object_show(trov->overlay.obj);
-            e_popup_edje_bg_object_set(trov->overlay.popup,
-                                       trov->overlay.obj);
-
-            evas_object_show(trov->overlay.obj);
-            e_popup_show(trov->overlay.popup);
-
+            _overlay_size_get(trov->overlay.obj, OVERLAY_HINT, trov->key,
+                              &ew, &eh);
             if (_G.tinfo->conf->use_rows) {
-                e_popup_move_resize(trov->overlay.popup,
-                                    (trov->overlay.popup->zone->w/2 - ew/2),
-                                    (_G.tinfo->pos[trov->stack]
-                                     + _G.tinfo->size[trov->stack]
-                                     - trov->overlay.popup->zone->y - eh/2),
-                                    ew, eh);
+                _overlay_geometry_set(&trov->overlay,
+                                      (trov->overlay.zone->w/2 - ew/2),
+                                      (_G.tinfo->pos[trov->stack]
+                                       + _G.tinfo->size[trov->stack]
+                                       - trov->overlay.zone->y - eh/2),
+                                      ew, eh);
             } else {
-                e_popup_move_resize(trov->overlay.popup,
-                                    (_G.tinfo->pos[trov->stack]
-                                     + _G.tinfo->size[trov->stack]
-                                     - trov->overlay.popup->zone->x - ew/2),
-                                    (trov->overlay.popup->zone->h/2 - eh/2),
-                                    ew, eh);
+                _overlay_geometry_set(&trov->overlay,
+                                      (_G.tinfo->pos[trov->stack]
+                                       + _G.tinfo->size[trov->stack]
+                                       - trov->overlay.zone->x - ew/2),
+                                      (trov->overlay.zone->h/2 - eh/2),
+                                      ew, eh);
             }
-
-            e_popup_show(trov->overlay.popup);
+            _overlay_visible_set(&trov->overlay, true);
         }
     }
 
@@ -3151,7 +5509,6 @@ _do_transition_overlay(void)
     _G.action_timer = ecore_timer_add(TILING_OVERLAY_TIMEOUT,
                                       _timeout_cb, NULL);
 
-    _G.keys[0] = '\0';
     _G.handler_key = ecore_event_handler_add(ECORE_EVENT_KEY_DOWN,
                                              _transition_overlay_key_down,
                                              NULL);
@@ -3175,6 +5532,318 @@ _e_mod_action_adjust_transitions(E_Object   *obj,
     _do_transition_overlay();
 }
 
+/* }}} */
+/* Split handles {{{ */
+
+/* Takes the next handle of _G.handles, or a new one, and puts it over
+ * @x, @y, @w, @h of the container of the desk of @tinfo, for the
+ * boundary after @bd in @stack, or after @stack when @bd is NULL */
+static void
+_handle_place(Eina_List **next, const Tiling_Info *tinfo, int stack,
+              E_Border *bd, int x, int y, int w, int h)
+{
+    E_Container *con = tinfo->desk->zone->container;
+    Ecore_X_Window parent = con->win;
+    bool vertical = !!bd != !!tinfo->conf->use_rows;
+    handle_t *handle;
+
+    if (*next) {
+        handle = (*next)->data;
+        *next = (*next)->next;
+    } else {
+        handle = E_NEW(handle_t, 1);
+        _G.handles = eina_list_append(_G.handles, handle);
+    }
+
+    if (handle->parent != parent) {
+        if (handle->win)
+            ecore_x_window_free(handle->win);
+        handle->win = ecore_x_window_input_new(parent, x, y, w, h);
+        handle->parent = parent;
+        handle->vertical = !vertical;
+    }
+    if (handle->vertical != vertical) {
+        ecore_x_window_cursor_set(handle->win, ecore_x_cursor_shape_get(
+            vertical ? ECORE_X_CURSOR_SB_V_DOUBLE_ARROW
+                     : ECORE_X_CURSOR_SB_H_DOUBLE_ARROW));
+    }
+
+    handle->desk = tinfo->desk;
+    handle->stack = stack;
+    handle->bd = bd;
+    handle->vertical = vertical;
+    handle->geom = (geom_t) { x, y, w, h };
+    ecore_x_window_move_resize(handle->win, x, y, w, h);
+    /* Right above the tiled windows, below floating ones and dialogs */
+    e_container_window_raise(con, handle->win, TILING_BORDER_LAYER);
+    ecore_x_window_show(handle->win);
+}
+
+/* Whether a window of the desk of @tinfo covers it whole, fullscreen
+ * or maximized in both directions other than by the layout */
+static bool
+_handles_covered(const Tiling_Info *tinfo)
+{
+    const Eina_List *l;
+    E_Border *bd;
+
+    EINA_LIST_FOREACH(tinfo->windows, l, bd) {
+        Border_Extra *extra;
+        bool tiled = false;
+
+        if (bd->iconic)
+            continue;
+        if (bd->fullscreen)
+            return true;
+        if ((bd->maximized & E_MAXIMIZE_DIRECTION) != E_MAXIMIZE_BOTH)
+            continue;
+        for (int i = 0; i < TILING_MAX_STACKS && !tiled; i++)
+            tiled = EINA_LIST_IS_IN(tinfo->stacks[i], bd);
+        extra = eina_hash_find(_G.border_extras, &bd);
+        if (!tiled || !extra || extra->maximize != E_MAXIMIZE_BOTH)
+            return true;
+    }
+
+    return false;
+}
+
+static Eina_Bool
+_handles_place_tinfo(const Eina_Hash *hash, const void *key,
+                     void *data, void *fdata)
+{
+    const Tiling_Info *tinfo = data;
+    const E_Zone *zone = tinfo->desk->zone;
+    Eina_List **next = fdata;
+    int half = TILING_HANDLE_SIZE / 2;
+
+    if (!tinfo->desk->visible || !tinfo->conf || !tinfo->conf->nb_stacks
+    ||  _handles_covered(tinfo))
+        return true;
+
+    for (int i = 0; i < TILING_MAX_STACKS && tinfo->stacks[i]; i++) {
+        for (Eina_List *l = tinfo->stacks[i]; l && l->next; l = l->next) {
+            E_Border *bd = l->data;
+            Border_Extra *extra = eina_hash_find(_G.border_extras, &bd);
+            const geom_t *g;
+
+            if (!extra)
+                continue;
+            g = &extra->expected;
+            if (tinfo->conf->use_rows)
+                _handle_place(next, tinfo, i, bd, g->x + g->w - half, g->y,
+                              TILING_HANDLE_SIZE, g->h);
+            else
+                _handle_place(next, tinfo, i, bd, g->x, g->y + g->h - half,
+                              g->w, TILING_HANDLE_SIZE);
+        }
+        if (i + 1 < TILING_MAX_STACKS && tinfo->stacks[i + 1]) {
+            int edge = tinfo->pos[i] + tinfo->size[i];
+
+            if (tinfo->conf->use_rows)
+                _handle_place(next, tinfo, i, NULL, zone->x, edge - half,
+                              zone->w, TILING_HANDLE_SIZE);
+            else
+                _handle_place(next, tinfo, i, NULL, edge - half, zone->y,
+                              TILING_HANDLE_SIZE, zone->h);
+        }
+    }
+
+    return true;
+}
+
+static void
+_handles_update_job(void *data)
+{
+    Eina_List *next = _G.handles;
+
+    _G.handles_job = NULL;
+
+    /* Placed again once dropped */
+    if (_G.drag.handle)
+        return;
+
+    eina_hash_foreach(_G.info_hash, _handles_place_tinfo, &next);
+    for (; next; next = next->next) {
+        handle_t *handle = next->data;
+
+        if (!handle->desk)
+            continue;
+        ecore_x_window_hide(handle->win);
+        handle->desk = NULL;
+        handle->bd = NULL;
+    }
+}
+
+/* Puts the handles over the boundaries of the visible desks again,
+ * once the events being handled are */
+static void
+_handles_queue(void)
+{
+    if (!_G.handles_job)
+        _G.handles_job = ecore_job_add(_handles_update_job, NULL);
+}
+
+/* Moves the boundary being dragged towards the pointer. Returns whether
+ * it moved. */
+static bool
+_handle_drag_step(void)
+{
+    handle_t *handle = _G.drag.handle;
+    int delta;
+
+    if (_G.drag.target == _G.drag.pos
+    ||  !eina_hash_find(_G.info_hash, &handle->desk))
+        return false;
+
+    check_tinfo(handle->desk);
+    if (!_G.tinfo->conf)
+        return false;
+
+    delta = _boundary_move(handle->stack, handle->bd,
+                           _G.drag.target - _G.drag.pos);
+    if (!delta)
+        return false;
+
+    _G.drag.pos += delta;
+    if (handle->vertical)
+        handle->geom.y += delta;
+    else
+        handle->geom.x += delta;
+    ecore_x_window_move_resize(handle->win, handle->geom.x, handle->geom.y,
+                               handle->geom.w, handle->geom.h);
+    return true;
+}
+
+/* Applies the motion of the pointer at most once per frame, however
+ * many motion events came in between */
+static Eina_Bool
+_handle_drag_cb(void *data)
+{
+    if (_G.drag.handle && _handle_drag_step())
+        return ECORE_CALLBACK_RENEW;
+
+    _G.drag.animator = NULL;
+    return ECORE_CALLBACK_CANCEL;
+}
+
+/* Stops dragging, moving the boundary where it was dropped if
+ * @commit */
+static void
+_handle_drag_end(bool commit)
+{
+    handle_t *handle = _G.drag.handle;
+
+    if (!handle)
+        return;
+
+    if (_G.drag.animator) {
+        ecore_animator_del(_G.drag.animator);
+        _G.drag.animator = NULL;
+    }
+    if (commit)
+        _handle_drag_step();
+
+    e_grabinput_release(handle->win, 0);
+    if (_G.handler_mouse_move) {
+        ecore_event_handler_del(_G.handler_mouse_move);
+        _G.handler_mouse_move = NULL;
+    }
+    if (_G.handler_mouse_up) {
+        ecore_event_handler_del(_G.handler_mouse_up);
+        _G.handler_mouse_up = NULL;
+    }
+    _G.drag.handle = NULL;
+    _handles_queue();
+}
+
+/* Stops dragging if @bd going away changes the boundary being dragged:
+ * it is on the desk of the handle, whose stacks get laid out again */
+static void
+_handle_drag_cancel_for(const E_Border *bd)
+{
+    handle_t *handle = _G.drag.handle;
+
+    if (handle && (bd == handle->bd || bd->desk == handle->desk))
+        _handle_drag_end(false);
+}
+
+static Eina_Bool
+_handle_mouse_move(void *data, int type, Ecore_Event_Mouse_Move *ev)
+{
+    if (!_G.drag.handle)
+        return ECORE_CALLBACK_PASS_ON;
+
+    _G.drag.target = _G.drag.handle->vertical ? ev->root.y : ev->root.x;
+    if (!_G.drag.animator)
+        _G.drag.animator = ecore_animator_add(_handle_drag_cb, NULL);
+
+    return ECORE_CALLBACK_PASS_ON;
+}
+
+static Eina_Bool
+_handle_mouse_up(void *data, int type, Ecore_Event_Mouse_Button *ev)
+{
+    if (!_G.drag.handle || ev->buttons != 1)
+        return ECORE_CALLBACK_PASS_ON;
+
+    _G.drag.target = _G.drag.handle->vertical ? ev->root.y : ev->root.x;
+    _handle_drag_end(true);
+
+    return ECORE_CALLBACK_DONE;
+}
+
+static Eina_Bool
+_handle_mouse_down(void *data, int type, Ecore_Event_Mouse_Button *ev)
+{
+    handle_t *handle = NULL,
+             *h;
+    Eina_List *l;
+
+    if (_G.drag.handle || ev->buttons != 1)
+        return ECORE_CALLBACK_PASS_ON;
+
+    EINA_LIST_FOREACH(_G.handles, l, h) {
+        if (h->desk && h->win == ev->event_window) {
+            handle = h;
+            break;
+        }
+    }
+    if (!handle || !eina_hash_find(_G.info_hash, &handle->desk))
+        return ECORE_CALLBACK_PASS_ON;
+
+    end_special_input();
+    if (!e_grabinput_get(handle->win, 0, 0))
+        return ECORE_CALLBACK_PASS_ON;
+
+    _G.drag.handle = handle;
+    _G.drag.pos = _G.drag.target = handle->vertical ? ev->root.y
+                                                    : ev->root.x;
+    _G.handler_mouse_move = ecore_event_handler_add(
+        ECORE_EVENT_MOUSE_MOVE, (Ecore_Event_Handler_Cb) _handle_mouse_move,
+        NULL);
+    _G.handler_mouse_up = ecore_event_handler_add(
+        ECORE_EVENT_MOUSE_BUTTON_UP, (Ecore_Event_Handler_Cb) _handle_mouse_up,
+        NULL);
+
+    return ECORE_CALLBACK_DONE;
+}
+
+static void
+_handles_free(void)
+{
+    handle_t *handle;
+
+    _handle_drag_end(false);
+    if (_G.handles_job) {
+        ecore_job_del(_G.handles_job);
+        _G.handles_job = NULL;
+    }
+    EINA_LIST_FREE(_G.handles, handle) {
+        ecore_x_window_free(handle->win);
+        free(handle);
+    }
+}
+
 /* }}} */
 /* Go {{{ */
 
@@ -3239,10 +5908,28 @@ _e_mod_action_go_cb(E_Object   *obj,
 /* }}} */
 /* Hooks {{{*/
 
+static void
+_pre_fetch_hook(void *data,
+                E_Border *bd)
+{
+    if (!bd)
+        return;
+
+    if (bd->client.icccm.fetch.size_pos_hints
+    ||  bd->client.icccm.fetch.transient_for
+    ||  bd->client.icccm.fetch.name_class
+    ||  bd->client.icccm.fetch.window_role
+    ||  bd->client.netwm.fetch.type)
+    {
+        eina_hash_del_by_key(_G.tilable, &bd);
+    }
+}
+
 static void
 _pre_border_assign_hook(void *data,
                         E_Border *bd)
 {
+    const struct _Config_rule *rule;
     Border_Extra *extra;
 
     if (tiling_g.config->show_titles)
@@ -3252,6 +5939,15 @@ _pre_border_assign_hook(void *data,
         return;
     }
 
+    /* Cheapest tests first, this runs on every eval */
+    if (!is_tilable(bd)) {
+        return;
+    }
+
+    if (bd->fullscreen) {
+         return;
+    }
+
     check_tinfo(bd->desk);
     if (!_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
         return;
@@ -3261,14 +5957,11 @@ _pre_border_assign_hook(void *data,
         return;
     }
 
-    if (!is_tilable(bd)) {
+    rule = _rule_find(bd);
+    if (rule && rule->action == TILING_RULE_SKIP_BORDER) {
         return;
     }
 
-    if (bd->fullscreen) {
-         return;
-    }
-
     extra = _get_or_create_border_extra(bd);
 
     if ((bd->bordername && strcmp(bd->bordername, "pixel"))
@@ -3278,10 +5971,26 @@ _pre_border_assign_hook(void *data,
     }
 }
 
+/* Floats @bd if it keeps answering its tiled geometry with one of its
+ * own */
+static bool
+_watchdog_check(E_Border *bd, Border_Extra *extra)
+{
+    if (!_watchdog_tripped(extra))
+        return false;
+
+    WRN("%s (%p) keeps fighting its tiled geometry, floating it",
+        bd->client.icccm.class ? bd->client.icccm.class : "?", bd);
+    _float_border(bd);
+
+    return true;
+}
+
 static void _move_or_resize(E_Border *bd)
 {
     Border_Extra *extra;
     int stack = -1;
+    bool tiled = true;
 
     if (!bd) {
         return;
@@ -3326,7 +6035,9 @@ static void _move_or_resize(E_Border *bd)
         bd->client.icccm.step_w, bd->client.icccm.step_h,
         bd->client.icccm.base_w, bd->client.icccm.base_h);
 
-    if (stack == 0 && !_G.tinfo->stacks[1] && !_G.tinfo->stacks[0]->next) {
+    extra->maximize = _desired_maximize(stack,
+                                        eina_list_count(_G.tinfo->stacks[stack]));
+    if (extra->maximize == E_MAXIMIZE_BOTH) {
         if (bd->maximized) {
             extra->expected.x = bd->x;
             extra->expected.y = bd->y;
@@ -3334,8 +6045,9 @@ static void _move_or_resize(E_Border *bd)
             extra->expected.h = bd->h;
         } else {
             /* TODO: what if a window doesn't want to be maximized? */
-            _e_border_unmaximize(bd, E_MAXIMIZE_BOTH);
-            _e_border_maximize(bd, E_MAXIMIZE_EXPAND | E_MAXIMIZE_BOTH);
+            if (!_watchdog_check(bd, extra))
+                _commit_border(bd, extra);
+            return;
         }
     }
     if (bd->x == extra->expected.x && bd->y == extra->expected.y
@@ -3343,88 +6055,62 @@ static void _move_or_resize(E_Border *bd)
     {
         return;
     }
-    if (bd->maximized) {
-        bool changed = false;
 
-        if (_G.tinfo->conf->use_rows) {
-            if (stack > 0 && bd->maximized & E_MAXIMIZE_VERTICAL) {
-                 _e_border_unmaximize(bd, E_MAXIMIZE_VERTICAL);
-                 _e_border_move_resize(bd,
-                                       extra->expected.x,
-                                       extra->expected.y,
-                                       extra->expected.w,
-                                       extra->expected.h);
-                 changed = true;
-            }
-            if (bd->maximized & E_MAXIMIZE_HORIZONTAL
-            && eina_list_count(_G.tinfo->stacks[stack]) > 1) {
-                 _e_border_unmaximize(bd, E_MAXIMIZE_HORIZONTAL);
-                 _e_border_move_resize(bd,
-                                       extra->expected.x,
-                                       extra->expected.y,
-                                       extra->expected.w,
-                                       extra->expected.h);
-                 changed = true;
-            }
-        } else {
-            if (stack > 0 && bd->maximized & E_MAXIMIZE_HORIZONTAL) {
-                 _e_border_unmaximize(bd, E_MAXIMIZE_HORIZONTAL);
-                 _e_border_move_resize(bd,
-                                       extra->expected.x,
-                                       extra->expected.y,
-                                       extra->expected.w,
-                                       extra->expected.h);
-                 changed = true;
-            }
-            if (bd->maximized & E_MAXIMIZE_VERTICAL
-            && eina_list_count(_G.tinfo->stacks[stack]) > 1) {
-                 _e_border_unmaximize(bd, E_MAXIMIZE_VERTICAL);
-                 _e_border_move_resize(bd,
-                                       extra->expected.x,
-                                       extra->expected.y,
-                                       extra->expected.w,
-                                       extra->expected.h);
-                 changed = true;
-            }
-        }
-        if (changed)
-            return;
+    /* Only the corrections, here and where a border is not allowed to
+     * move or resize, count for the watchdog: the other changes are the
+     * user's, which the layout follows */
+    if (bd->maximized & E_MAXIMIZE_DIRECTION & ~extra->maximize) {
+        if (!_watchdog_check(bd, extra))
+            _commit_border(bd, extra);
+        return;
     }
 
     if ((bd->changes.border && bd->changes.size)
         || bd->x <= 0 || bd->y <= 0) {
-        _e_border_move_resize(bd,
-                              extra->expected.x,
-                              extra->expected.y,
-                              extra->expected.w,
-                              extra->expected.h);
+        if (!_watchdog_check(bd, extra))
+            _e_border_move_resize(bd,
+                                  extra->expected.x,
+                                  extra->expected.y,
+                                  extra->expected.w,
+                                  extra->expected.h);
         return;
     }
 
+    /* Once floated, @extra is gone */
     if (abs(extra->expected.w - bd->w) >= bd->client.icccm.step_w) {
         if (_G.tinfo->conf->use_rows)
-            _move_resize_border_in_stack(bd, extra, stack, TILING_RESIZE);
+            tiled = _move_resize_border_in_stack(bd, extra, stack,
+                                                 TILING_RESIZE);
         else
-            _move_resize_border_stack(bd, extra, stack, TILING_RESIZE);
+            tiled = _move_resize_border_stack(bd, extra, stack,
+                                              TILING_RESIZE);
     }
-    if (abs(extra->expected.h - bd->h) >= bd->client.icccm.step_h) {
+    if (tiled && abs(extra->expected.h - bd->h) >= bd->client.icccm.step_h) {
         if (_G.tinfo->conf->use_rows)
-            _move_resize_border_stack(bd, extra, stack, TILING_RESIZE);
+            tiled = _move_resize_border_stack(bd, extra, stack,
+                                              TILING_RESIZE);
         else
-            _move_resize_border_in_stack(bd, extra, stack, TILING_RESIZE);
+            tiled = _move_resize_border_in_stack(bd, extra, stack,
+                                                 TILING_RESIZE);
     }
-    if (extra->expected.x != bd->x) {
+    if (tiled && extra->expected.x != bd->x) {
         if (_G.tinfo->conf->use_rows)
-            _move_resize_border_in_stack(bd, extra, stack, TILING_MOVE);
+            tiled = _move_resize_border_in_stack(bd, extra, stack,
+                                                 TILING_MOVE);
         else
-            _move_resize_border_stack(bd, extra, stack, TILING_MOVE);
+            tiled = _move_resize_border_stack(bd, extra, stack,
+                                              TILING_MOVE);
     }
-    if (extra->expected.y != bd->y) {
+    if (tiled && extra->expected.y != bd->y) {
         if (_G.tinfo->conf->use_rows)
-            _move_resize_border_stack(bd, extra, stack, TILING_MOVE);
+            tiled = _move_resize_border_stack(bd, extra, stack,
+                                              TILING_MOVE);
         else
-            _move_resize_border_in_stack(bd, extra, stack, TILING_MOVE);
+            tiled = _move_resize_border_in_stack(bd, extra, stack,
+                                                 TILING_MOVE);
     }
+    if (!tiled)
+        return;
 
     if (_G.input_mode == INPUT_MODE_MOVING
     &&  bd == _G.focused_bd) {
@@ -3438,6 +6124,7 @@ _resize_hook(void *data, int type, E_Event_Border_Resize *event)
     E_Border *bd = event->border;
 
     _move_or_resize(bd);
+    _handles_queue();
 
     return true;
 }
@@ -3448,6 +6135,7 @@ _move_hook(void *data, int type, E_Event_Border_Move*event)
     E_Border *bd = event->border;
 
     _move_or_resize(bd);
+    _handles_queue();
 
     return true;
 }
@@ -3465,6 +6153,8 @@ _add_hook(void *data, int type, E_Event_Border_Add *event)
         end_special_input();
     }
 
+    _index_add(bd);
+
     check_tinfo(bd->desk);
     if (!_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
         return true;
@@ -3479,6 +6169,10 @@ _add_hook(void *data, int type, E_Event_Border_Add *event)
         return true;
     }
 
+    if (_rule_float(bd)) {
+        return true;
+    }
+
     DBG("Add: %p / '%s' / '%s', (%d,%d), changes(size=%d, position=%d, border=%d)"
         " g:%dx%d+%d+%d bdname:'%s' (stack:%d%c) maximized:%s fs:%s",
         bd, bd->client.icccm.title, bd->client.netwm.name,
@@ -3491,7 +6185,7 @@ _add_hook(void *data, int type, E_Event_Border_Add *event)
         (bd->maximized & E_MAXIMIZE_DIRECTION) == E_MAXIMIZE_HORIZONTAL ? "HORIZONTAL" :
         "BOTH", bd->fullscreen? "true": "false");
 
-    _add_border(bd);
+    _queue_border(bd);
 
     return true;
 }
@@ -3502,6 +6196,14 @@ _remove_hook(void *data, int type, E_Event_Border_Remove *event)
     E_Border *bd = event->border;
 
     end_special_input();
+    _handle_drag_cancel_for(bd);
+    _handles_queue();
+
+    eina_hash_del_by_key(_G.tilable, &bd);
+    _index_remove(bd->desk, bd);
+
+    if (_unqueue_border(bd->desk, bd))
+        return EINA_TRUE;
 
     if (_G.currently_switching_desktop)
         return EINA_TRUE;
@@ -3515,6 +6217,7 @@ _remove_hook(void *data, int type, E_Event_Border_Remove *event)
         return EINA_TRUE;
     }
 
+    _placement_remember(bd);
     _remove_border(bd);
 
     return EINA_TRUE;
@@ -3526,6 +6229,13 @@ _iconify_hook(void *_, int type, E_Event_Border_Iconify *event)
     E_Border *bd = event->border;
 
     end_special_input();
+    _handle_drag_cancel_for(bd);
+    _handles_queue();
+
+    _index_set_iconic(bd, true);
+
+    if (_unqueue_border(bd->desk, bd))
+        return true;
 
     check_tinfo(bd->desk);
     if (!_G.tinfo->conf)
@@ -3553,6 +6263,8 @@ _uniconify_hook(void *_, int type, E_Event_Border_Uniconify *event)
         end_special_input();
     }
 
+    _index_set_iconic(bd, false);
+
     check_tinfo(bd->desk);
     if (!_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
         return true;
@@ -3591,6 +6303,7 @@ _desk_show_hook(void *data, int type, void *event)
     _G.currently_switching_desktop = 0;
 
     end_special_input();
+    _handles_queue();
 
     return EINA_TRUE;
 }
@@ -3599,12 +6312,26 @@ static Eina_Bool
 _desk_before_show_hook(void *data, int type, void *event)
 {
     end_special_input();
+    _handle_drag_end(false);
 
     _G.currently_switching_desktop = 1;
 
     return EINA_TRUE;
 }
 
+static bool
+_focus_in_hook(void *data, int type, E_Event_Border_Focus_In *ev)
+{
+    Border_Extra *extra = eina_hash_find(_G.border_extras, &ev->border);
+
+    if (extra)
+        _usage_bump(extra);
+    /* Focusing may have raised it above the handles */
+    _handles_queue();
+
+    return true;
+}
+
 static bool
 _desk_set_hook(void *data, int type, E_Event_Border_Desk_Set *ev)
 {
@@ -3614,6 +6341,10 @@ _desk_set_hook(void *data, int type, E_Event_Border_Desk_Set *ev)
 
     end_special_input();
 
+    _unqueue_border(ev->desk, ev->border);
+    _index_remove(ev->desk, ev->border);
+    _index_add(ev->border);
+
     check_tinfo(ev->desk);
     if (!_G.tinfo->conf) {
         return true;
@@ -3635,54 +6366,482 @@ _desk_set_hook(void *data, int type, E_Event_Border_Desk_Set *ev)
     return true;
 }
 
+/* }}} */
+/* Background layouts {{{*/
+
+/* Copies what the layout of _G.tinfo depends on */
+static snapshot_t *
+_snapshot_take(void)
+{
+    snapshot_t *snap;
+    int nb_stacks = get_stack_count();
+    int count = 0, n = 0;
+
+    for (int i = 0; i < nb_stacks; i++) {
+        count += eina_list_count(_G.tinfo->stacks[i]);
+    }
+
+    snap = E_NEW(snapshot_t, 1);
+    snap->desk = _G.tinfo->desk;
+    e_zone_useful_geometry_get(_G.tinfo->desk->zone,
+                               &snap->zone.x, &snap->zone.y,
+                               &snap->zone.w, &snap->zone.h);
+    snap->use_rows = _G.tinfo->conf->use_rows;
+    snap->nb_stacks = nb_stacks;
+    snap->count = count;
+    snap->spans = E_NEW(span_t, count);
+    snap->borders = E_NEW(E_Border *, count);
+    snap->geoms = E_NEW(geom_t, count);
+
+    for (int i = 0; i < nb_stacks; i++) {
+        snap->counts[i] = eina_list_count(_G.tinfo->stacks[i]);
+        /* Stacks keep their share of the zone */
+        snap->stacks[i].weight = _G.tinfo->size[i];
+        _stack_span(_G.tinfo->stacks[i], !snap->use_rows, &snap->stacks[i]);
+
+        for (Eina_List *l = _G.tinfo->stacks[i]; l; l = l->next, n++) {
+            E_Border *bd = l->data;
+            Border_Extra *extra;
+
+            extra = eina_hash_find(_G.border_extras, &bd);
+            snap->borders[n] = bd;
+            snap->spans[n].weight = extra ? extra->weight : 0;
+            _border_span(bd, snap->use_rows, &snap->spans[n]);
+        }
+    }
+
+    return snap;
+}
+
+static void
+_snapshot_free(snapshot_t *snap)
+{
+    free(snap->spans);
+    free(snap->borders);
+    free(snap->geoms);
+    free(snap);
+}
+
+/* Runs on a worker thread: only reads and writes @data, then hands it
+ * back to the main loop through the pipe */
+static void
+_snapshot_solve(void *data, Ecore_Thread *thread)
+{
+    snapshot_t *snap = data;
+    int first = 0;
+
+    eina_lock_take(&_G.snapshots_lock);
+    if (snap->cancelled) {
+        snap->finished = true;
+        eina_lock_release(&_G.snapshots_lock);
+        return;
+    }
+    _G.solving++;
+    eina_lock_release(&_G.snapshots_lock);
+
+    if (snap->use_rows)
+        _split_stack_spans(snap->zone.y, snap->zone.h, snap->nb_stacks,
+                           snap->stacks, snap->pos, snap->size);
+    else
+        _split_stack_spans(snap->zone.x, snap->zone.w, snap->nb_stacks,
+                           snap->stacks, snap->pos, snap->size);
+
+    for (int i = 0; i < snap->nb_stacks; i++) {
+        bool lonely = (snap->nb_stacks == 1 && snap->counts[0] == 1);
+
+        if (ecore_thread_check(thread))
+            break;
+        _spans_layout(&snap->zone, snap->use_rows, snap->counts[i],
+                      &snap->spans[first], snap->pos[i], snap->size[i],
+                      lonely, &snap->geoms[first]);
+        first += snap->counts[i];
+    }
+
+    /* The pipe is gone once the snapshot is cancelled, and @snap is
+     * freed by the main loop once sent */
+    eina_lock_take(&_G.snapshots_lock);
+    snap->finished = true;
+    if (!snap->cancelled)
+        ecore_pipe_write(_G.snapshots_pipe, &snap, sizeof(snap));
+    _G.solving--;
+    eina_condition_signal(&_G.snapshots_cond);
+    eina_lock_release(&_G.snapshots_lock);
+}
+
+/* Whether the desk of _G.tinfo is still as it was when @snap was taken */
 static bool
-_container_resize_hook(void *_, int type, E_Event_Container_Resize *ev)
+_snapshot_valid(const snapshot_t *snap)
 {
-    Eina_List *l;
-    E_Zone *zone;
+    geom_t zone;
+    int n = 0;
 
-    EINA_LIST_FOREACH(ev->container->zones, l, zone) {
-        for (int x = 0; x < zone->desk_x_count; x++)
-        {
-            for (int y = 0; y < zone->desk_y_count; y++) {
-                E_Desk *desk = zone->desks[x + (y * zone->desk_x_count)];
-                Eina_List *wins = NULL;
-                E_Border *bd;
+    e_zone_useful_geometry_get(_G.tinfo->desk->zone,
+                               &zone.x, &zone.y, &zone.w, &zone.h);
+    if (zone.x != snap->zone.x || zone.y != snap->zone.y
+    ||  zone.w != snap->zone.w || zone.h != snap->zone.h)
+        return false;
+    if (_G.tinfo->conf->use_rows != snap->use_rows
+    ||  get_stack_count() != snap->nb_stacks)
+        return false;
 
-                check_tinfo(desk);
-                if (!_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
-                    continue;
-                }
+    for (int i = 0; i < snap->nb_stacks; i++) {
+        for (Eina_List *l = _G.tinfo->stacks[i]; l; l = l->next) {
+            if (n >= snap->count || l->data != snap->borders[n++])
+                return false;
+        }
+    }
 
-                for (int i = 0; i < TILING_MAX_STACKS; i++) {
-                    EINA_LIST_FREE(_G.tinfo->stacks[i], bd) {
-                        EINA_LIST_APPEND(wins, bd);
-                        _restore_border(bd);
-                    }
-                    _G.tinfo->stacks[i] = NULL;
-                    _G.tinfo->pos[i] = 0;
-                    _G.tinfo->size[i] = 0;
-                }
+    return n == snap->count;
+}
+
+/* Back on the main loop: moves the windows where the worker put them */
+static void
+_snapshot_apply(void *data, void *buffer, unsigned int nbyte)
+{
+    snapshot_t *snap;
+    Tiling_Info *tinfo = _G.tinfo;
+    int n = 0;
+
+    if (nbyte != sizeof(snap))
+        return;
+    memcpy(&snap, buffer, sizeof(snap));
+    EINA_LIST_REMOVE(_G.snapshots, snap);
+
+    /* Do not bring back the Tiling_Info of a desk gone meanwhile */
+    if (!eina_hash_find(_G.info_hash, &snap->desk)) {
+        _snapshot_free(snap);
+        return;
+    }
+
+    check_tinfo(snap->desk);
+    if (!_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
+        ;
+    } else
+    if (!_snapshot_valid(snap)) {
+        DBG("desk %d,%d changed while being laid out, starting over",
+            snap->desk->x, snap->desk->y);
+        _queue_relayout(snap->desk);
+    } else {
+        for (int i = 0; i < snap->nb_stacks; i++) {
+            _G.tinfo->pos[i] = snap->pos[i];
+            _G.tinfo->size[i] = snap->size[i];
 
-                EINA_LIST_FREE(wins, bd) {
-                    _add_border(bd);
+            for (Eina_List *l = _G.tinfo->stacks[i]; l; l = l->next, n++) {
+                E_Border *bd = l->data;
+                Border_Extra *extra;
+
+                extra = eina_hash_find(_G.border_extras, &bd);
+                if (!extra) {
+                    ERR("No extra for %p", bd);
+                    continue;
                 }
+
+                extra->expected = snap->geoms[n];
+                extra->maximize = _desired_maximize(i, snap->counts[i]);
+                _update_weight(extra);
+                _commit_border(bd, extra);
             }
         }
     }
 
+    _G.tinfo = tinfo;
+    _snapshot_free(snap);
+}
+
+/* Lays the hidden desk of _G.tinfo out again, keeping every window in
+ * its stack. The sizes are solved on a worker thread from a snapshot,
+ * so that many desks can be solved at once, and only the moves are
+ * made on the main loop. */
+static void
+_relayout_desk_async(void)
+{
+    snapshot_t *snap = _snapshot_take();
+    Ecore_Thread *thread;
+
+    /* The results come back through _G.snapshots_pipe rather than
+     * through callbacks of Ecore, which could run after the module is
+     * gone */
+    thread = ecore_thread_run(_snapshot_solve, NULL, NULL, snap);
+    if (!thread) {
+        _snapshot_free(snap);
+        return;
+    }
+    snap->thread = thread;
+    EINA_LIST_APPEND(_G.snapshots, snap);
+}
+
+/* Stops every worker thread and waits, for TILING_THREADS_TIMEOUT at
+ * most, for them to leave the code of the module. The main loop is not
+ * run meanwhile, and the snapshots already sent are dropped with the
+ * pipe. */
+static void
+_snapshots_cancel(void)
+{
+    double deadline = ecore_time_get() + TILING_THREADS_TIMEOUT;
+    Eina_List *l;
+    snapshot_t *snap;
+    bool done;
+
+    eina_lock_take(&_G.snapshots_lock);
+    EINA_LIST_FOREACH(_G.snapshots, l, snap) {
+        snap->cancelled = true;
+        /* Drops the jobs not started yet. No callback is given to
+         * Ecore, so nothing runs from here. */
+        if (!snap->finished)
+            ecore_thread_cancel(snap->thread);
+    }
+    while (_G.solving) {
+        double left = deadline - ecore_time_get();
+
+        if (left <= 0)
+            break;
+        eina_condition_timedwait(&_G.snapshots_cond, left);
+    }
+    done = !_G.solving;
+    eina_lock_release(&_G.snapshots_lock);
+
+    ecore_pipe_del(_G.snapshots_pipe);
+    _G.snapshots_pipe = NULL;
+
+    if (!done) {
+        /* Leaked rather than freed under the feet of the workers */
+        ERR("%d worker threads still running", _G.solving);
+        _G.snapshots = eina_list_free(_G.snapshots);
+        return;
+    }
+    EINA_LIST_FREE(_G.snapshots, snap) {
+        _snapshot_free(snap);
+    }
+    eina_condition_free(&_G.snapshots_cond);
+    eina_lock_free(&_G.snapshots_lock);
+}
+
+/* }}} */
+/* Relayout scheduling {{{*/
+
+/* Lays every tiled window of @desk out again from scratch, or in the
+ * background if it is hidden */
+static void
+_relayout_desk(const E_Desk *desk)
+{
+    Eina_List *wins = NULL;
+    E_Border *bd;
+
+    check_tinfo(desk);
+    if (_G.tinfo->conf_pending) {
+        _desk_conf_apply();
+        return;
+    }
+    if (!_G.tinfo->conf || !_G.tinfo->conf->nb_stacks) {
+        return;
+    }
+
+    if (!desk->visible) {
+        if (get_stack_count())
+            _relayout_desk_async();
+        return;
+    }
+
+    for (int i = 0; i < TILING_MAX_STACKS; i++) {
+        EINA_LIST_FREE(_G.tinfo->stacks[i], bd) {
+            EINA_LIST_APPEND(wins, bd);
+            _restore_border(bd);
+        }
+        _G.tinfo->stacks[i] = NULL;
+        _G.tinfo->pos[i] = 0;
+        _G.tinfo->size[i] = 0;
+    }
+
+    /* Already tiled, maybe by hand against a rule */
+    _add_borders(wins, false);
+    eina_list_free(wins);
+}
+
+/* The lower, the sooner: the desk the user is looking at, then the
+ * other visible desks, then the hidden ones */
+static int
+_relayout_priority(const E_Desk *desk, const E_Zone *zone)
+{
+    if (!desk->visible)
+        return 2;
+    return desk->zone == zone ? 0 : 1;
+}
+
+static Eina_Bool
+_relayout_idler_cb(void *data)
+{
+    double start = ecore_time_get();
+    const E_Desk *current = get_current_desk();
+    /* Without a current desk, visible desks still come first */
+    const E_Zone *zone = current ? current->zone : NULL;
+
+    while (_G.relayout_desks) {
+        Eina_List *best = _G.relayout_desks;
+        const E_Desk *desk;
+
+        for (Eina_List *l = best->next; l; l = l->next) {
+            if (_relayout_priority(l->data, zone)
+              < _relayout_priority(best->data, zone))
+                best = l;
+        }
+        desk = best->data;
+        _G.relayout_desks = eina_list_remove_list(_G.relayout_desks, best);
+
+        DBG("relayout of desk %d,%d on zone %d",
+            desk->x, desk->y, desk->zone->num);
+        _relayout_desk(desk);
+
+        if (ecore_time_get() - start > TILING_JOBS_BUDGET)
+            break;
+    }
+    if (current)
+        check_tinfo(current);
+
+    if (_G.relayout_desks)
+        return ECORE_CALLBACK_RENEW;
+
+    _G.relayout_idler = NULL;
+    return ECORE_CALLBACK_CANCEL;
+}
+
+/* Lays @desk out again when the main loop is idle, sooner if the user
+ * is looking at it */
+static void
+_queue_relayout(const E_Desk *desk)
+{
+    if (!EINA_LIST_IS_IN(_G.relayout_desks, desk))
+        EINA_LIST_APPEND(_G.relayout_desks, desk);
+    if (!_G.relayout_idler)
+        _G.relayout_idler = ecore_idler_add(_relayout_idler_cb, NULL);
+}
+
+static void
+_unqueue_relayouts(void)
+{
+    if (_G.relayout_idler) {
+        ecore_idler_del(_G.relayout_idler);
+        _G.relayout_idler = NULL;
+    }
+    _G.relayout_desks = eina_list_free(_G.relayout_desks);
+}
+
+static Eina_Bool
+_queue_relayout_tinfo(const Eina_Hash *hash, const void *key,
+                      void *data, void *fdata)
+{
+    Tiling_Info *tinfo = data;
+    const E_Zone *zone = fdata;
+
+    if (tinfo->desk && tinfo->desk->zone == zone
+    &&  tinfo->conf && tinfo->conf->nb_stacks)
+        _queue_relayout(tinfo->desk);
+
+    return EINA_TRUE;
+}
+
+static Eina_Bool
+_dead_tinfo_collect(const Eina_Hash *hash, const void *key,
+                    void *data, void *fdata)
+{
+    Tiling_Info *tinfo = data;
+    Eina_List **dead = fdata;
+
+    if (tinfo->desk && !_desk_exists(tinfo->desk))
+        EINA_LIST_APPEND(*dead, tinfo->desk);
+
+    return EINA_TRUE;
+}
+
+/* Forgets the desks gone with their zone, or with the desks of their
+ * zone being fewer, before anything queued for them dereferences them */
+static void
+_desks_purge(void)
+{
+    Eina_List *dead = NULL;
+    const E_Desk *desk;
+
+    eina_hash_foreach(_G.info_hash, _dead_tinfo_collect, &dead);
+    if (dead)
+        _handles_queue();
+    EINA_LIST_FREE(dead, desk) {
+        DBG("forgetting removed desk %p", desk);
+        EINA_LIST_REMOVE(_G.relayout_desks, desk);
+        if (_G.tinfo && _G.tinfo->desk == desk)
+            _G.tinfo = NULL;
+        eina_hash_del_by_key(_G.info_hash, &desk);
+    }
+}
+
+static bool
+_zone_desks_hook(void *_, int type, void *ev)
+{
+    _desks_purge();
+
+    return true;
+}
+
+static bool
+_zone_del_hook(void *_, int type, void *ev)
+{
+    _desks_purge();
+    _overlay_pools_purge();
+
+    return true;
+}
+
+static bool
+_container_resize_hook(void *_, int type, E_Event_Container_Resize *ev)
+{
+    Eina_List *l;
+    E_Zone *zone;
+
+    _desks_purge();
+    _overlay_pools_purge();
+
+    /* Only desks with a Tiling_Info can have tiled windows */
+    EINA_LIST_FOREACH(ev->container->zones, l, zone) {
+        eina_hash_foreach(_G.info_hash, _queue_relayout_tinfo, zone);
+    }
+
+    return true;
+}
+
+static bool
+_zone_move_resize_hook(void *_, int type, E_Event_Zone_Move_Resize *ev)
+{
+    eina_hash_foreach(_G.info_hash, _queue_relayout_tinfo, ev->zone);
+
     return true;
 }
 
 /* }}} */
 /* Module setup {{{*/
 
+static Eina_Bool
+_pending_timer_del(const Eina_Hash *hash, const void *key,
+                   void *data, void *fdata)
+{
+    Tiling_Info *ti = data;
+
+    if (ti->pending_timer) {
+        ecore_timer_del(ti->pending_timer);
+        ti->pending_timer = NULL;
+    }
+
+    return EINA_TRUE;
+}
+
 static void
 _clear_info_hash(void *data)
 {
     Tiling_Info *ti = data;
 
+    if (ti->pending_timer)
+        ecore_timer_del(ti->pending_timer);
+    eina_list_free(ti->pending_windows);
+    eina_list_free(ti->windows);
     eina_list_free(ti->floating_windows);
+    eina_list_free(ti->iconified_windows);
     for (int i = 0; i < TILING_MAX_STACKS; i++) {
         eina_list_free(ti->stacks[i]);
         ti->stacks[i] = NULL;
@@ -3727,10 +6886,18 @@ e_modapi_init(E_Module *m)
 
     _G.info_hash = eina_hash_pointer_new(_clear_info_hash);
     _G.border_extras = eina_hash_pointer_new(_clear_border_extras);
+    _G.tilable = eina_hash_pointer_new(NULL);
+
+    _G.snapshots_pipe = ecore_pipe_add(_snapshot_apply, NULL);
+    eina_lock_new(&_G.snapshots_lock);
+    eina_condition_new(&_G.snapshots_cond, &_G.snapshots_lock);
 
     _G.pre_border_assign_hook = e_border_hook_add(
         E_BORDER_HOOK_EVAL_PRE_BORDER_ASSIGN,
         (void (*)(void*,void*))_pre_border_assign_hook, NULL);
+    _G.pre_fetch_hook = e_border_hook_add(
+        E_BORDER_HOOK_EVAL_PRE_FETCH,
+        (void (*)(void*,void*))_pre_fetch_hook, NULL);
 
 #define HANDLER(_h, _e, _f)                                   \
     _h = ecore_event_handler_add(E_EVENT_##_e,                \
@@ -3751,7 +6918,14 @@ e_modapi_init(E_Module *m)
     HANDLER(_G.handler_desk_before_show, DESK_BEFORE_SHOW, _desk_before_show_hook);
     HANDLER(_G.handler_desk_set, BORDER_DESK_SET, _desk_set_hook);
     HANDLER(_G.handler_container_resize, CONTAINER_RESIZE, _container_resize_hook);
+    HANDLER(_G.handler_zone_move_resize, ZONE_MOVE_RESIZE, _zone_move_resize_hook);
+    HANDLER(_G.handler_zone_del, ZONE_DEL, _zone_del_hook);
+    HANDLER(_G.handler_zone_desk_count_set, ZONE_DESK_COUNT_SET, _zone_desks_hook);
+    HANDLER(_G.handler_border_focus_in, BORDER_FOCUS_IN, _focus_in_hook);
 #undef HANDLER
+    _G.handler_mouse_down = ecore_event_handler_add(
+        ECORE_EVENT_MOUSE_BUTTON_DOWN,
+        (Ecore_Event_Handler_Cb) _handle_mouse_down, NULL);
 
 #define ACTION_ADD(_act, _cb, _title, _value)                                \
     {                                                                        \
@@ -3796,9 +6970,22 @@ e_modapi_init(E_Module *m)
     _G.config_edd = E_CONFIG_DD_NEW("Tiling_Config", Config);
     _G.vdesk_edd = E_CONFIG_DD_NEW("Tiling_Config_VDesk",
                                    struct _Config_vdesk);
+    _G.rule_edd = E_CONFIG_DD_NEW("Tiling_Config_Rule",
+                                  struct _Config_rule);
+    _G.placements_edd = E_CONFIG_DD_NEW("Tiling_Config_Placements",
+                                        struct _Config_placements);
+    _G.placement_edd = E_CONFIG_DD_NEW("Tiling_Config_Placement",
+                                       struct _Config_placement);
+    _G.layout_edd = E_CONFIG_DD_NEW("Tiling_Config_Layout",
+                                    struct _Config_layout);
+    _G.layout_window_edd = E_CONFIG_DD_NEW("Tiling_Config_Layout_Window",
+                                           struct _Config_layout_window);
+    E_CONFIG_VAL(_G.config_edd, Config, version, INT);
     E_CONFIG_VAL(_G.config_edd, Config, tile_dialogs, INT);
     E_CONFIG_VAL(_G.config_edd, Config, show_titles, INT);
     E_CONFIG_VAL(_G.config_edd, Config, keyhints, STR);
+    E_CONFIG_VAL(_G.config_edd, Config, add_delay, INT);
+    E_CONFIG_VAL(_G.config_edd, Config, animations, INT);
 
     E_CONFIG_LIST(_G.config_edd, Config, vdesks, _G.vdesk_edd);
     E_CONFIG_VAL(_G.vdesk_edd, struct _Config_vdesk, x, INT);
@@ -3807,12 +6994,54 @@ e_modapi_init(E_Module *m)
     E_CONFIG_VAL(_G.vdesk_edd, struct _Config_vdesk, nb_stacks, INT);
     E_CONFIG_VAL(_G.vdesk_edd, struct _Config_vdesk, use_rows, INT);
 
+    E_CONFIG_LIST(_G.config_edd, Config, rules, _G.rule_edd);
+    E_CONFIG_VAL(_G.rule_edd, struct _Config_rule, class, STR);
+    E_CONFIG_VAL(_G.rule_edd, struct _Config_rule, name, STR);
+    E_CONFIG_VAL(_G.rule_edd, struct _Config_rule, role, STR);
+    E_CONFIG_VAL(_G.rule_edd, struct _Config_rule, type, INT);
+    E_CONFIG_VAL(_G.rule_edd, struct _Config_rule, action, INT);
+    E_CONFIG_VAL(_G.rule_edd, struct _Config_rule, stack, INT);
+
+    E_CONFIG_LIST(_G.placements_edd, struct _Config_placements, placements,
+                  _G.placement_edd);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, class, STR);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, role, STR);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, x, INT);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, y, INT);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, zone_num, INT);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, stack, INT);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, position, INT);
+    E_CONFIG_VAL(_G.placement_edd, struct _Config_placement, weight, INT);
+
+    E_CONFIG_LIST(_G.layout_edd, struct _Config_layout, windows,
+                  _G.layout_window_edd);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window, win,
+                 UINT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window, x, INT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window, y, INT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window,
+                 zone_num, INT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window, stack,
+                 INT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window,
+                 position, INT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window, weight,
+                 INT);
+    E_CONFIG_VAL(_G.layout_window_edd, struct _Config_layout_window,
+                 stack_size, INT);
+
     tiling_g.config = e_config_domain_load("module.e-tiling", _G.config_edd);
     if (!tiling_g.config) {
         tiling_g.config = E_NEW(Config, 1);
         tiling_g.config->tile_dialogs = 1;
         tiling_g.config->show_titles = 1;
     }
+    /* New configurations go through every upgrade too */
+    if (tiling_g.config->version < 1) {
+        /* Fields brought by version 1 */
+        tiling_g.config->add_delay = 50;
+    }
+    tiling_g.config->version = TILING_CONFIG_VERSION;
     if (!tiling_g.config->keyhints)
         tiling_g.config->keyhints = strdup(tiling_g.default_keyhints);
     else
@@ -3820,6 +7049,9 @@ e_modapi_init(E_Module *m)
 
     E_CONFIG_LIMIT(tiling_g.config->tile_dialogs, 0, 1);
     E_CONFIG_LIMIT(tiling_g.config->show_titles, 0, 1);
+    E_CONFIG_LIMIT(tiling_g.config->add_delay, 0, 1000);
+    E_CONFIG_LIMIT(tiling_g.config->animations, TILING_ANIMATIONS_AUTO,
+                   TILING_ANIMATIONS_OFF);
 
     for (Eina_List *l = tiling_g.config->vdesks; l; l = l->next) {
         struct _Config_vdesk *vd;
@@ -3830,6 +7062,41 @@ e_modapi_init(E_Module *m)
         E_CONFIG_LIMIT(vd->use_rows, 0, 1);
     }
 
+    for (Eina_List *l = tiling_g.config->rules; l; l = l->next) {
+        struct _Config_rule *rule = l->data;
+
+        E_CONFIG_LIMIT(rule->action, TILING_RULE_FLOAT,
+                       TILING_RULE_SKIP_BORDER);
+        E_CONFIG_LIMIT(rule->stack, 0, TILING_MAX_STACKS - 1);
+    }
+    _rules_compile();
+
+    _G.placements = e_config_domain_load("module.e-tiling.placement",
+                                         _G.placements_edd);
+    if (!_G.placements)
+        _G.placements = E_NEW(struct _Config_placements, 1);
+    for (Eina_List *l = _G.placements->placements; l; l = l->next) {
+        struct _Config_placement *pl = l->data;
+
+        E_CONFIG_LIMIT(pl->stack, 0, TILING_MAX_STACKS - 1);
+        E_CONFIG_LIMIT(pl->position, 0, 1024);
+        E_CONFIG_LIMIT(pl->weight, 0, 32767);
+    }
+    _placements_index();
+
+    _G.layout = e_config_domain_load("module.e-tiling.layout", _G.layout_edd);
+    if (!_G.layout)
+        _G.layout = E_NEW(struct _Config_layout, 1);
+    for (Eina_List *l = _G.layout->windows; l; l = l->next) {
+        struct _Config_layout_window *lw = l->data;
+
+        E_CONFIG_LIMIT(lw->stack, 0, TILING_MAX_STACKS - 1);
+        E_CONFIG_LIMIT(lw->position, 0, 1024);
+        E_CONFIG_LIMIT(lw->weight, 0, 32767);
+        E_CONFIG_LIMIT(lw->stack_size, 0, 32767);
+    }
+    _layout_index();
+
     desk = get_current_desk();
     _G.tinfo = _initialize_tinfo(desk);
 
@@ -3837,6 +7104,15 @@ e_modapi_init(E_Module *m)
     _G.currently_switching_desktop = 0;
     _G.action_cb = NULL;
 
+    /* The theme can not change without a restart */
+    _overlay_themes_load();
+    _G.overlay_pool = eina_hash_pointer_new(_overlay_pool_free_cb);
+    _G.hint_canvases = eina_hash_pointer_new(_hint_canvas_free_cb);
+    _G.comp_spares = eina_hash_pointer_new(_comp_spares_free_cb);
+    _overlay_pool_warm();
+
+    _tile_existing_borders();
+
     return m;
 }
 
@@ -3853,6 +7129,10 @@ e_modapi_shutdown(E_Module *m)
         e_border_hook_del(_G.pre_border_assign_hook);
         _G.pre_border_assign_hook = NULL;
     }
+    if (_G.pre_fetch_hook) {
+        e_border_hook_del(_G.pre_fetch_hook);
+        _G.pre_fetch_hook = NULL;
+    }
 
 #define FREE_HANDLER(x)              \
     if (x) {                         \
@@ -3872,8 +7152,25 @@ e_modapi_shutdown(E_Module *m)
     FREE_HANDLER(_G.handler_desk_show);
     FREE_HANDLER(_G.handler_desk_before_show);
     FREE_HANDLER(_G.handler_desk_set);
+    FREE_HANDLER(_G.handler_container_resize);
+    FREE_HANDLER(_G.handler_zone_move_resize);
+    FREE_HANDLER(_G.handler_zone_del);
+    FREE_HANDLER(_G.handler_zone_desk_count_set);
+    FREE_HANDLER(_G.handler_border_focus_in);
+    FREE_HANDLER(_G.handler_mouse_down);
 #undef FREE_HANDLER
 
+    _handles_free();
+
+    /* Nothing of the module is to run while waiting for the threads */
+    end_special_input();
+    eina_hash_foreach(_G.info_hash, _pending_timer_del, NULL);
+    if (_G.overlay_pool_idler) {
+        ecore_idler_del(_G.overlay_pool_idler);
+        _G.overlay_pool_idler = NULL;
+    }
+    _snapshots_cancel();
+    _unqueue_relayouts();
 
 #define ACTION_DEL(act, title, value)                        \
     if (act) {                                               \
@@ -3895,12 +7192,33 @@ e_modapi_shutdown(E_Module *m)
     e_configure_registry_item_del("windows/e-tiling");
     e_configure_registry_category_del("windows");
 
-    end_special_input();
+    eina_hash_free(_G.overlay_pool);
+    _G.overlay_pool = NULL;
+    eina_hash_free(_G.hint_canvases);
+    _G.hint_canvases = NULL;
+    eina_hash_free(_G.comp_spares);
+    _G.comp_spares = NULL;
+    _overlay_themes_free();
+
+    _layout_save();
+    {
+        struct _Config_layout_window *lw;
+
+        EINA_LIST_FREE(_G.layout->windows, lw) {
+            free(lw);
+        }
+    }
+    E_FREE(_G.layout);
+    eina_hash_free(_G.layout_hash);
+    _G.layout_hash = NULL;
+    E_CONFIG_DD_FREE(_G.layout_window_edd);
+    E_CONFIG_DD_FREE(_G.layout_edd);
 
     free(tiling_g.config->keyhints);
     E_FREE(tiling_g.config);
     E_CONFIG_DD_FREE(_G.config_edd);
     E_CONFIG_DD_FREE(_G.vdesk_edd);
+    E_CONFIG_DD_FREE(_G.rule_edd);
 
     tiling_g.module = NULL;
 
@@ -3910,6 +7228,29 @@ e_modapi_shutdown(E_Module *m)
     eina_hash_free(_G.border_extras);
     _G.border_extras = NULL;
 
+    eina_hash_free(_G.tilable);
+    _G.tilable = NULL;
+
+    _rules_free();
+
+    if (_G.placements_timer) {
+        ecore_timer_del(_G.placements_timer);
+        _G.placements_timer = NULL;
+    }
+    _placements_save();
+    eina_hash_free(_G.placement_hash);
+    _G.placement_hash = NULL;
+    {
+        struct _Config_placement *pl;
+
+        EINA_LIST_FREE(_G.placements->placements, pl) {
+            _placement_free(pl);
+        }
+    }
+    E_FREE(_G.placements);
+    E_CONFIG_DD_FREE(_G.placement_edd);
+    E_CONFIG_DD_FREE(_G.placements_edd);
+
     _G.tinfo = NULL;
 
     return 1;
@@ -3919,6 +7260,8 @@ EAPI int
 e_modapi_save(E_Module *m)
 {
     e_config_domain_save("module.e-tiling", _G.config_edd, tiling_g.config);
+    _placements_save();
+    _layout_save();
 
     return EINA_TRUE;
 }
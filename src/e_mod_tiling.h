@@ -24,6 +24,7 @@ struct tiling_g
 extern struct tiling_g tiling_g;
 
 #define ERR(...) EINA_LOG_DOM_ERR(tiling_g.log_domain, __VA_ARGS__)
+#define WRN(...) EINA_LOG_DOM_WARN(tiling_g.log_domain, __VA_ARGS__)
 #define DBG(...) EINA_LOG_DOM_DBG(tiling_g.log_domain, __VA_ARGS__)
 
 #define TILING_MAX_STACKS 8
@@ -36,12 +37,83 @@ struct _Config_vdesk
    int           use_rows;
 };
 
+typedef enum {
+    TILING_RULE_FLOAT,
+    TILING_RULE_STACK,
+    TILING_RULE_SKIP_BORDER,
+} tiling_rule_action_t;
+
+/* Whether the move and transition overlays are animated. AUTO keeps
+ * them still when the popups are rendered in software */
+typedef enum {
+    TILING_ANIMATIONS_AUTO,
+    TILING_ANIMATIONS_ON,
+    TILING_ANIMATIONS_OFF,
+} tiling_animations_t;
+
+/* Windows matching every field set (class, name, role, type) get
+ * @action. @stack is the stack to put them in, starting at 0, for
+ * TILING_RULE_STACK */
+struct _Config_rule
+{
+   const char   *class;
+   const char   *name;
+   const char   *role;
+   int           type;
+   int           action;
+   int           stack;
+};
+
+/* Where a window of @class and @role was last tiled on a desk */
+struct _Config_placement
+{
+   const char   *class;
+   const char   *role;
+   int           x, y;
+   unsigned int  zone_num;
+   int           stack;
+   int           position;
+   int           weight;
+};
+
+/* Root of the module.e-tiling.placement domain, oldest entries first */
+struct _Config_placements
+{
+   Eina_List    *placements;
+};
+
+/* Where the window @win was tiled when the layout was last saved */
+struct _Config_layout_window
+{
+   unsigned int  win;
+   int           x, y;
+   unsigned int  zone_num;
+   int           stack;
+   int           position;
+   int           weight;
+   int           stack_size;
+};
+
+/* Root of the module.e-tiling.layout domain */
+struct _Config_layout
+{
+   Eina_List    *windows;
+};
+
+/* Bumped when a new field needs a default in configurations saved by
+ * an older version, see e_modapi_init() */
+#define TILING_CONFIG_VERSION 1
+
 struct _Config
 {
+    int            version;
     int            tile_dialogs;
     int            show_titles;
     char          *keyhints;
+    int            add_delay;
+    int            animations;
     Eina_List     *vdesks;
+    Eina_List     *rules;
 };
 
 struct _Tiling_Info
@@ -53,9 +125,26 @@ struct _Tiling_Info
 
     struct _Config_vdesk *conf;
 
+    /* The stacks and orientation in use while a new configuration waits
+     * to be applied by the relayout queue, see change_desk_conf() */
+    bool conf_pending;
+    int  applied_nb_stacks;
+    int  applied_use_rows;
+
+    /* Every window of the desk, whether tiled, floating or iconified,
+     * kept up to date by the hooks */
+    Eina_List *windows;
+
     /* List of windows which were toggled floating */
     Eina_List *floating_windows;
 
+    /* Windows of the desk currently iconified */
+    Eina_List *iconified_windows;
+
+    /* New windows waiting to be placed together, see add_delay */
+    Eina_List   *pending_windows;
+    Ecore_Timer *pending_timer;
+
     Eina_List *stacks[TILING_MAX_STACKS];
     int        pos[TILING_MAX_STACKS];
     int        size[TILING_MAX_STACKS];